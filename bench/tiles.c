@@ -0,0 +1,70 @@
+// benchmark of the dirty tile detection on 4k frames, build with make bench
+#include "tiles.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define WIDTH 3840
+#define HEIGHT 2160
+#define BPP 4
+#define ITERATIONS 50
+#define FRAME_INTERVAL_MS (1000.0 / 60.0)
+
+static double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// change a number of scattered pixels in the frame
+static void scribble(uint8_t* frame, uint32_t pixels, uint32_t seed) {
+    for (uint32_t i = 0; i < pixels; i++) {
+        seed = seed * 1103515245 + 12345;
+        frame[(size_t) (seed % (WIDTH * HEIGHT)) * BPP] ^= 0xff;
+    }
+}
+
+int main() {
+    const size_t size = (size_t) WIDTH * HEIGHT * BPP;
+    const uint32_t tile_count = ((WIDTH + TILE_SIZE - 1) / TILE_SIZE) * ((HEIGHT + TILE_SIZE - 1) / TILE_SIZE);
+    uint8_t* previous = malloc(size);
+    uint8_t* frame = malloc(size);
+    uint8_t* dirty = malloc(tile_count);
+    for (size_t i = 0; i < size; i++)
+        frame[i] = (uint8_t) (i * 31 + (i >> 12));
+
+    // unchanged frames are the worst case, every byte is compared
+    static const struct {
+        const char* name;
+        uint32_t pixels;
+    } scenarios[] = { { "unchanged", 0 }, { "cursor", 1 }, { "typing", 32 }, { "scattered", 4096 }, { "full", WIDTH * HEIGHT } };
+
+    printf("%ux%u frames, %u tiles of %ux%u, one frame at 60 Hz is %.2f ms\n", WIDTH, HEIGHT, tile_count, TILE_SIZE, TILE_SIZE, FRAME_INTERVAL_MS);
+    tiles_kernel best = tiles_kernel_best();
+    for (tiles_kernel kernel = TILES_SCALAR; kernel <= best; kernel++) {
+        for (size_t s = 0; s < sizeof(scenarios) / sizeof(scenarios[0]); s++) {
+            double total = 0, worst = 0;
+            uint64_t changed = 0;
+            for (int i = 0; i < ITERATIONS; i++) {
+                memcpy(previous, frame, size);
+                scribble(frame, scenarios[s].pixels, i + 1);
+
+                double start = now_ms();
+                changed += tiles_compare(kernel, previous, WIDTH * BPP, frame, WIDTH * BPP, WIDTH, HEIGHT, BPP, dirty);
+                double elapsed = now_ms() - start;
+                total += elapsed;
+                worst = elapsed > worst ? elapsed : worst;
+            }
+            printf("%-6s %-9s %7.3f ms avg %7.3f ms max %6lu dirty tiles (%4.1f%% of a frame interval)\n",
+                tiles_kernel_name(kernel), scenarios[s].name, total / ITERATIONS, worst, changed / ITERATIONS,
+                total / ITERATIONS / FRAME_INTERVAL_MS * 100);
+        }
+    }
+
+    free(previous);
+    free(frame);
+    free(dirty);
+    return 0;
+}
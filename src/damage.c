@@ -0,0 +1,45 @@
+#include "damage.h"
+
+// damage region
+
+static damage_rect damage_region_bounds(const damage_region* region) {
+    uint32_t x1 = UINT32_MAX, y1 = UINT32_MAX, x2 = 0, y2 = 0;
+    for (uint32_t i = 0; i < region->count; i++) {
+        const damage_rect* rect = &region->rects[i];
+        x1 = rect->x < x1 ? rect->x : x1;
+        y1 = rect->y < y1 ? rect->y : y1;
+        x2 = rect->x + rect->width > x2 ? rect->x + rect->width : x2;
+        y2 = rect->y + rect->height > y2 ? rect->y + rect->height : y2;
+    }
+    return (damage_rect) { x1, y1, x2 - x1, y2 - y1 };
+}
+
+void damage_region_add(damage_region* region, int32_t x, int32_t y, int32_t width, int32_t height, uint32_t frame_width, uint32_t frame_height) {
+    // clip to the frame
+    int64_t x1 = x > 0 ? x : 0, y1 = y > 0 ? y : 0;
+    int64_t x2 = (int64_t) x + width, y2 = (int64_t) y + height;
+    x2 = x2 < frame_width ? x2 : frame_width;
+    y2 = y2 < frame_height ? y2 : frame_height;
+    if (x2 <= x1 || y2 <= y1)
+        return;
+
+    // collapse into the bounding box instead of dropping damage
+    if (region->count == MAX_DAMAGE_RECTS) {
+        region->rects[0] = damage_region_bounds(region);
+        region->count = 1;
+    }
+
+    region->rects[region->count++] = (damage_rect) { x1, y1, x2 - x1, y2 - y1 };
+}
+
+void damage_region_full(damage_region* region, uint32_t frame_width, uint32_t frame_height) {
+    region->rects[0] = (damage_rect) { 0, 0, frame_width, frame_height };
+    region->count = frame_width && frame_height ? 1 : 0;
+}
+
+void damage_region_union(damage_region* region, const damage_region* other, uint32_t frame_width, uint32_t frame_height) {
+    for (uint32_t i = 0; i < other->count; i++) {
+        const damage_rect* rect = &other->rects[i];
+        damage_region_add(region, rect->x, rect->y, rect->width, rect->height, frame_width, frame_height);
+    }
+}
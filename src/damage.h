@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define MAX_DAMAGE_RECTS 16
+
+typedef struct {
+    uint32_t x, y;
+    uint32_t width, height;
+} damage_rect;
+
+typedef struct {
+    damage_rect rects[MAX_DAMAGE_RECTS];
+    uint32_t count;
+} damage_region;
+
+// add a rectangle clipped to the frame, the region collapses into its bounding box once full
+void damage_region_add(damage_region* region, int32_t x, int32_t y, int32_t width, int32_t height, uint32_t frame_width, uint32_t frame_height);
+
+// replace the region with the whole frame
+void damage_region_full(damage_region* region, uint32_t frame_width, uint32_t frame_height);
+
+// merge another region into this one
+void damage_region_union(damage_region* region, const damage_region* other, uint32_t frame_width, uint32_t frame_height);
@@ -0,0 +1,163 @@
+#include "device.h"
+
+#include <obs/util/base.h>
+#include <obs/util/bmem.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/sysmacros.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef struct device_entry {
+    dev_t rdev; // render nodes are matched by device number, so symlinks like /dev/dri/by-path share a device
+    int fd;
+    struct gbm_device* gbm;
+    uint32_t references;
+    struct device_entry* next;
+} device_entry;
+
+static device_entry* devices = NULL;
+static pthread_mutex_t devices_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// shared devices
+
+struct gbm_device* device_acquire(const char* path) {
+    if (!path || strlen(path) == 0)
+        path = DEVICE_DEFAULT_RENDER_NODE;
+
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISCHR(st.st_mode)) {
+        blog(LOG_ERROR, "Render node %s does not exist", path);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&devices_mutex);
+    device_entry* entry;
+    for (entry = devices; entry; entry = entry->next)
+        if (entry->rdev == st.st_rdev)
+            break;
+
+    // open the node once for all sources
+    if (!entry) {
+        int fd = open(path, O_RDWR | O_CLOEXEC);
+        struct gbm_device* gbm = fd >= 0 ? gbm_create_device(fd) : NULL;
+        if (!gbm) {
+            if (fd >= 0)
+                close(fd);
+            pthread_mutex_unlock(&devices_mutex);
+            blog(LOG_ERROR, "Failed to create GBM device for %s", path);
+            return NULL;
+        }
+
+        entry = bzalloc(sizeof(device_entry));
+        entry->rdev = st.st_rdev;
+        entry->fd = fd;
+        entry->gbm = gbm;
+        entry->next = devices;
+        devices = entry;
+        blog(LOG_INFO, "Opened GBM device %s (%s)", path, gbm_device_get_backend_name(gbm));
+    }
+
+    entry->references++;
+    pthread_mutex_unlock(&devices_mutex);
+    return entry->gbm;
+}
+
+void device_release(struct gbm_device* gbm) {
+    if (!gbm)
+        return;
+
+    pthread_mutex_lock(&devices_mutex);
+    for (device_entry** link = &devices; *link; link = &(*link)->next) {
+        device_entry* entry = *link;
+        if (entry->gbm != gbm)
+            continue;
+
+        // close the node with its last source
+        if (--entry->references == 0) {
+            *link = entry->next;
+            gbm_device_destroy(entry->gbm);
+            close(entry->fd);
+            bfree(entry);
+        }
+        break;
+    }
+    pthread_mutex_unlock(&devices_mutex);
+}
+
+// gpu identification
+
+static bool device_sysfs_path(dev_t node, char* path) {
+    // nodes of one gpu link to the same parent device
+    char link[64];
+    snprintf(link, sizeof(link), "/sys/dev/char/%u:%u/device", major(node), minor(node));
+    return realpath(link, path) != NULL;
+}
+
+bool device_same_gpu(dev_t a, dev_t b) {
+    if (a == b)
+        return true;
+
+    char path_a[PATH_MAX], path_b[PATH_MAX];
+    return device_sysfs_path(a, path_a) && device_sysfs_path(b, path_b) && strcmp(path_a, path_b) == 0;
+}
+
+void device_driver(dev_t node, char* name, size_t size) {
+    char link[64], path[PATH_MAX];
+    snprintf(link, sizeof(link), "/sys/dev/char/%u:%u/device/driver", major(node), minor(node));
+    const char* driver = realpath(link, path) ? strrchr(path, '/') : NULL;
+    snprintf(name, size, "%s", driver ? driver + 1 : "unknown");
+}
+
+dev_t device_renderer() {
+    // the current display is the one of the obs graphics context
+    EGLDisplay display = eglGetCurrentDisplay();
+    PFNEGLQUERYDISPLAYATTRIBEXTPROC query_display = (PFNEGLQUERYDISPLAYATTRIBEXTPROC) eglGetProcAddress("eglQueryDisplayAttribEXT");
+    PFNEGLQUERYDEVICESTRINGEXTPROC query_device = (PFNEGLQUERYDEVICESTRINGEXTPROC) eglGetProcAddress("eglQueryDeviceStringEXT");
+    EGLAttrib device;
+    if (display == EGL_NO_DISPLAY || !query_display || !query_device || !query_display(display, EGL_DEVICE_EXT, &device))
+        return 0;
+
+    // older drivers only name the primary node, it belongs to the same gpu
+    const char* node = query_device((EGLDeviceEXT) device, EGL_DRM_RENDER_NODE_FILE_EXT);
+    if (!node)
+        node = query_device((EGLDeviceEXT) device, EGL_DRM_DEVICE_FILE_EXT);
+
+    struct stat st;
+    return node && stat(node, &st) == 0 ? st.st_rdev : 0;
+}
+
+dev_t device_number(struct gbm_device* gbm) {
+    struct stat st;
+    return gbm && fstat(gbm_device_get_fd(gbm), &st) == 0 ? st.st_rdev : 0;
+}
+
+struct gbm_device* device_acquire_gpu(dev_t node) {
+    // find the render node next to the given node
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "/sys/dev/char/%u:%u/device/drm", major(node), minor(node));
+    DIR* dir = opendir(path);
+    if (!dir) {
+        blog(LOG_ERROR, "Unable to find the gpu of drm node %u:%u", major(node), minor(node));
+        return NULL;
+    }
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) && strncmp(entry->d_name, "renderD", 7) != 0)
+        ;
+    if (entry)
+        snprintf(path, sizeof(path), "/dev/dri/%s", entry->d_name);
+    closedir(dir);
+    if (!entry) {
+        blog(LOG_ERROR, "The gpu of drm node %u:%u has no render node", major(node), minor(node));
+        return NULL;
+    }
+    return device_acquire(path);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <gbm.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#define DEVICE_DEFAULT_RENDER_NODE "/dev/dri/renderD128"
+
+// get the gbm device of a render node (default if NULL or empty), shared by all sources and referenced until released
+struct gbm_device* device_acquire(const char* path);
+void device_release(struct gbm_device* gbm);
+
+// get the gbm device of the gpu a drm node (primary or render) belongs to
+struct gbm_device* device_acquire_gpu(dev_t node);
+
+// render node obs renders on, queried from its egl display, 0 if unknown (requires graphics context)
+dev_t device_renderer();
+
+// device number of the render node a gbm device was opened on
+dev_t device_number(struct gbm_device* gbm);
+
+// check whether two drm nodes belong to the same gpu
+bool device_same_gpu(dev_t a, dev_t b);
+
+// kernel driver of a drm node, "unknown" if it cannot be determined
+void device_driver(dev_t node, char* name, size_t size);
@@ -0,0 +1,167 @@
+#include "effect.h"
+
+const char* screencopy_effect_source =
+    "uniform float4x4 ViewProj;\n"
+    "uniform texture2d image;\n"
+    "uniform float swap_rb;\n"
+    "uniform float multiplier;\n"
+    "uniform float white_point;\n"
+    "uniform float hlg_exponent;\n"
+    "uniform float2 downscale_offset;\n"
+    "\n"
+    "sampler_state def_sampler {\n"
+    "    Filter = Linear;\n"
+    "    AddressU = Clamp;\n"
+    "    AddressV = Clamp;\n"
+    "};\n"
+    "\n"
+    "struct VertInOut {\n"
+    "    float4 pos : POSITION;\n"
+    "    float2 uv : TEXCOORD0;\n"
+    "};\n"
+    "\n"
+    "VertInOut VSDefault(VertInOut vert_in) {\n"
+    "    VertInOut vert_out;\n"
+    "    vert_out.pos = mul(float4(vert_in.pos.xyz, 1.0), ViewProj);\n"
+    "    vert_out.uv = vert_in.uv;\n"
+    "    return vert_out;\n"
+    "}\n"
+    "\n"
+    "float srgb_nonlinear_to_linear_channel(float u) {\n"
+    "    return (u <= 0.04045) ? (u / 12.92) : pow((u + 0.055) / 1.055, 2.4);\n"
+    "}\n"
+    "\n"
+    "float3 srgb_nonlinear_to_linear(float3 v) {\n"
+    "    return float3(srgb_nonlinear_to_linear_channel(v.r), srgb_nonlinear_to_linear_channel(v.g), srgb_nonlinear_to_linear_channel(v.b));\n"
+    "}\n"
+    "\n"
+    "float st2084_to_linear_channel(float u) {\n"
+    "    float c = pow(abs(u), 1.0 / 78.84375);\n"
+    "    return pow(abs(max(c - 0.8359375, 0.0) / (18.8515625 - 18.6875 * c)), 1.0 / 0.1593017578);\n"
+    "}\n"
+    "\n"
+    "float3 st2084_to_linear(float3 v) {\n"
+    "    return float3(st2084_to_linear_channel(v.r), st2084_to_linear_channel(v.g), st2084_to_linear_channel(v.b));\n"
+    "}\n"
+    "\n"
+    "float hlg_to_scene_linear_channel(float u) {\n"
+    "    return (u <= 0.5) ? (u * u / 3.0) : ((exp((u - 0.55991073) / 0.17883277) + 0.28466892) / 12.0);\n"
+    "}\n"
+    "\n"
+    "float3 hlg_to_linear(float3 v) {\n"
+    "    float3 rgb = float3(hlg_to_scene_linear_channel(v.r), hlg_to_scene_linear_channel(v.g), hlg_to_scene_linear_channel(v.b));\n"
+    "    float luma = dot(rgb, float3(0.2627, 0.678, 0.0593));\n"
+    "    return rgb * pow(max(luma, 0.0), hlg_exponent);\n"
+    "}\n"
+    "\n"
+    "float3 rec2020_to_rec709(float3 v) {\n"
+    "    float r = dot(v, float3(1.6604910021084345, -0.58764113878854951, -0.072849863319884883));\n"
+    "    float g = dot(v, float3(-0.12455047452159074, 1.1328998971259603, -0.0083494226043694768));\n"
+    "    float b = dot(v, float3(-0.018150763354905303, -0.10057889800800739, 1.1187296613629127));\n"
+    "    return float3(r, g, b);\n"
+    "}\n"
+    "\n"
+    "float3 tonemap(float3 rgb) {\n"
+    "    // extended reinhard on the largest channel, white_point maps to 1.0\n"
+    "    float m = max(max(rgb.r, rgb.g), max(rgb.b, 0.0001));\n"
+    "    float mapped = m * (1.0 + m / (white_point * white_point)) / (1.0 + m);\n"
+    "    return rgb * (mapped / m);\n"
+    "}\n"
+    "\n"
+    "float3 sample_rgb(VertInOut vert_in) {\n"
+    "    float3 rgb = image.Sample(def_sampler, vert_in.uv).rgb;\n"
+    "    return lerp(rgb, rgb.bgr, swap_rb);\n"
+    "}\n"
+    "\n"
+    "float4 PSDownscale(VertInOut vert_in) : TARGET {\n"
+    "    // four bilinear taps average the source texels under the destination texel\n"
+    "    float4 rgba = image.Sample(def_sampler, vert_in.uv + float2(-downscale_offset.x, -downscale_offset.y));\n"
+    "    rgba += image.Sample(def_sampler, vert_in.uv + float2(downscale_offset.x, -downscale_offset.y));\n"
+    "    rgba += image.Sample(def_sampler, vert_in.uv + float2(-downscale_offset.x, downscale_offset.y));\n"
+    "    rgba += image.Sample(def_sampler, vert_in.uv + float2(downscale_offset.x, downscale_offset.y));\n"
+    "    return rgba * 0.25;\n"
+    "}\n"
+    "\n"
+    "float4 PSDraw(VertInOut vert_in) : TARGET {\n"
+    "    return float4(srgb_nonlinear_to_linear(sample_rgb(vert_in)) * multiplier, 1.0);\n"
+    "}\n"
+    "\n"
+    "float4 PSDrawLinear(VertInOut vert_in) : TARGET {\n"
+    "    return float4(sample_rgb(vert_in) * multiplier, 1.0);\n"
+    "}\n"
+    "\n"
+    "float4 PSDrawPQ(VertInOut vert_in) : TARGET {\n"
+    "    return float4(rec2020_to_rec709(st2084_to_linear(sample_rgb(vert_in)) * multiplier), 1.0);\n"
+    "}\n"
+    "\n"
+    "float4 PSDrawHLG(VertInOut vert_in) : TARGET {\n"
+    "    return float4(rec2020_to_rec709(hlg_to_linear(sample_rgb(vert_in)) * multiplier), 1.0);\n"
+    "}\n"
+    "\n"
+    "float4 PSDrawLinearTonemap(VertInOut vert_in) : TARGET {\n"
+    "    return float4(tonemap(sample_rgb(vert_in) * multiplier), 1.0);\n"
+    "}\n"
+    "\n"
+    "float4 PSDrawPQTonemap(VertInOut vert_in) : TARGET {\n"
+    "    return float4(tonemap(rec2020_to_rec709(st2084_to_linear(sample_rgb(vert_in)) * multiplier)), 1.0);\n"
+    "}\n"
+    "\n"
+    "float4 PSDrawHLGTonemap(VertInOut vert_in) : TARGET {\n"
+    "    return float4(tonemap(rec2020_to_rec709(hlg_to_linear(sample_rgb(vert_in)) * multiplier)), 1.0);\n"
+    "}\n"
+    "\n"
+    "technique Downscale {\n"
+    "    pass {\n"
+    "        vertex_shader = VSDefault(vert_in);\n"
+    "        pixel_shader = PSDownscale(vert_in);\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "technique Draw {\n"
+    "    pass {\n"
+    "        vertex_shader = VSDefault(vert_in);\n"
+    "        pixel_shader = PSDraw(vert_in);\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "technique DrawLinear {\n"
+    "    pass {\n"
+    "        vertex_shader = VSDefault(vert_in);\n"
+    "        pixel_shader = PSDrawLinear(vert_in);\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "technique DrawPQ {\n"
+    "    pass {\n"
+    "        vertex_shader = VSDefault(vert_in);\n"
+    "        pixel_shader = PSDrawPQ(vert_in);\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "technique DrawHLG {\n"
+    "    pass {\n"
+    "        vertex_shader = VSDefault(vert_in);\n"
+    "        pixel_shader = PSDrawHLG(vert_in);\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "technique DrawLinearTonemap {\n"
+    "    pass {\n"
+    "        vertex_shader = VSDefault(vert_in);\n"
+    "        pixel_shader = PSDrawLinearTonemap(vert_in);\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "technique DrawPQTonemap {\n"
+    "    pass {\n"
+    "        vertex_shader = VSDefault(vert_in);\n"
+    "        pixel_shader = PSDrawPQTonemap(vert_in);\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "technique DrawHLGTonemap {\n"
+    "    pass {\n"
+    "        vertex_shader = VSDefault(vert_in);\n"
+    "        pixel_shader = PSDrawHLGTonemap(vert_in);\n"
+    "    }\n"
+    "}\n";
@@ -0,0 +1,7 @@
+#pragma once
+
+// source of the effect used to draw captured frames, techniques:
+//   Draw, DrawLinear, DrawPQ, DrawHLG - decode into linear light scaled by multiplier
+//   DrawLinearTonemap, DrawPQTonemap, DrawHLGTonemap - same, tonemapped to sdr
+//   Downscale - box filtered copy that keeps the encoding, for rendering into a smaller texture
+extern const char* screencopy_effect_source;
@@ -0,0 +1,116 @@
+#include "format.h"
+
+#include <gbm.h>
+#include <obs/util/bmem.h>
+
+// format table
+
+static const format_info formats[] = {
+    // 8 bit formats
+    { GBM_FORMAT_XRGB8888, GS_BGRX, GS_CS_SRGB, false, GBM_FORMAT_XBGR8888 },
+    { GBM_FORMAT_ARGB8888, GS_BGRA, GS_CS_SRGB, false, GBM_FORMAT_ABGR8888 },
+    { GBM_FORMAT_XBGR8888, GS_RGBA, GS_CS_SRGB, false, GBM_FORMAT_XRGB8888 },
+    { GBM_FORMAT_ABGR8888, GS_RGBA, GS_CS_SRGB, false, GBM_FORMAT_ARGB8888 },
+
+    // formats without obs equivalent (the texture is sampled through the egl image)
+    { GBM_FORMAT_RGBX8888, GS_BGRX, GS_CS_SRGB, false, GBM_FORMAT_BGRX8888 },
+    { GBM_FORMAT_RGBA8888, GS_BGRA, GS_CS_SRGB, false, GBM_FORMAT_BGRA8888 },
+    { GBM_FORMAT_BGRX8888, GS_BGRX, GS_CS_SRGB, false, GBM_FORMAT_RGBX8888 },
+    { GBM_FORMAT_BGRA8888, GS_BGRA, GS_CS_SRGB, false, GBM_FORMAT_RGBA8888 },
+    { GBM_FORMAT_RGB565, GS_BGRX, GS_CS_SRGB, false, GBM_FORMAT_BGR565 },
+    { GBM_FORMAT_BGR565, GS_BGRX, GS_CS_SRGB, false, GBM_FORMAT_RGB565 },
+
+    // 10 bit formats
+    { GBM_FORMAT_XRGB2101010, GS_R10G10B10A2, GS_CS_SRGB_16F, false, GBM_FORMAT_XBGR2101010 },
+    { GBM_FORMAT_ARGB2101010, GS_R10G10B10A2, GS_CS_SRGB_16F, false, GBM_FORMAT_ABGR2101010 },
+    { GBM_FORMAT_XBGR2101010, GS_R10G10B10A2, GS_CS_SRGB_16F, false, GBM_FORMAT_XRGB2101010 },
+    { GBM_FORMAT_ABGR2101010, GS_R10G10B10A2, GS_CS_SRGB_16F, false, GBM_FORMAT_ARGB2101010 },
+    { GBM_FORMAT_RGBX1010102, GS_R10G10B10A2, GS_CS_SRGB_16F, false, GBM_FORMAT_BGRX1010102 },
+    { GBM_FORMAT_RGBA1010102, GS_R10G10B10A2, GS_CS_SRGB_16F, false, GBM_FORMAT_BGRA1010102 },
+    { GBM_FORMAT_BGRX1010102, GS_R10G10B10A2, GS_CS_SRGB_16F, false, GBM_FORMAT_RGBX1010102 },
+    { GBM_FORMAT_BGRA1010102, GS_R10G10B10A2, GS_CS_SRGB_16F, false, GBM_FORMAT_RGBA1010102 },
+
+    // 16 bit formats
+    { GBM_FORMAT_XBGR16161616, GS_RGBA16, GS_CS_SRGB_16F, false, 0 },
+    { GBM_FORMAT_ABGR16161616, GS_RGBA16, GS_CS_SRGB_16F, false, 0 },
+    { GBM_FORMAT_XBGR16161616F, GS_RGBA16F, GS_CS_SRGB_16F, true, 0 },
+    { GBM_FORMAT_ABGR16161616F, GS_RGBA16F, GS_CS_SRGB_16F, true, 0 },
+};
+
+const format_info* format_lookup(uint32_t drm_format) {
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++)
+        if (formats[i].drm_format == drm_format)
+            return &formats[i];
+
+    return NULL;
+}
+
+uint32_t format_bytes_per_pixel(uint32_t drm_format) {
+    switch (drm_format) {
+    case GBM_FORMAT_RGB565:
+    case GBM_FORMAT_BGR565:
+        return 2;
+    case GBM_FORMAT_XBGR16161616:
+    case GBM_FORMAT_ABGR16161616:
+    case GBM_FORMAT_XBGR16161616F:
+    case GBM_FORMAT_ABGR16161616F:
+        return 8;
+    default:
+        return format_lookup(drm_format) ? 4 : 0;
+    }
+}
+
+bool format_upload_supported(uint32_t drm_format, bool* swizzle) {
+    // the memory layout has to match the obs format, formats sampled through egl images are skipped
+    *swizzle = false;
+    switch (drm_format) {
+    case GBM_FORMAT_XRGB2101010:
+    case GBM_FORMAT_ARGB2101010:
+        *swizzle = true;
+        return true;
+    case GBM_FORMAT_XRGB8888:
+    case GBM_FORMAT_ARGB8888:
+    case GBM_FORMAT_XBGR8888:
+    case GBM_FORMAT_ABGR8888:
+    case GBM_FORMAT_XBGR2101010:
+    case GBM_FORMAT_ABGR2101010:
+    case GBM_FORMAT_XBGR16161616:
+    case GBM_FORMAT_ABGR16161616:
+    case GBM_FORMAT_XBGR16161616F:
+    case GBM_FORMAT_ABGR16161616F:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// dmabuf import support
+
+static uint32_t* dmabuf_formats = NULL;
+static size_t dmabuf_format_count = 0;
+static bool dmabuf_formats_queried = false;
+
+void format_query_dmabuf_support() {
+    enum gs_dmabuf_flags dmabuf_flags;
+    format_free_dmabuf_support();
+    dmabuf_formats_queried = gs_query_dmabuf_capabilities(&dmabuf_flags, &dmabuf_formats, &dmabuf_format_count);
+}
+
+void format_free_dmabuf_support() {
+    bfree(dmabuf_formats);
+    dmabuf_formats = NULL;
+    dmabuf_format_count = 0;
+    dmabuf_formats_queried = false;
+}
+
+bool format_dmabuf_supported(uint32_t drm_format) {
+    // assume support if obs is unable to tell
+    if (!dmabuf_formats_queried || dmabuf_format_count == 0)
+        return true;
+
+    for (size_t i = 0; i < dmabuf_format_count; i++)
+        if (dmabuf_formats[i] == drm_format)
+            return true;
+
+    return false;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <obs/graphics/graphics.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct {
+    uint32_t drm_format;
+    enum gs_color_format color_format;
+    enum gs_color_space color_space;
+    bool linear; // values are stored linear and must not be srgb decoded
+    uint32_t swapped_format; // same layout with red and blue swapped, 0 if none
+} format_info;
+
+// find the obs mapping of a drm format, NULL if unknown
+const format_info* format_lookup(uint32_t drm_format);
+
+// query the drm formats obs is able to import (requires graphics context)
+void format_query_dmabuf_support();
+void format_free_dmabuf_support();
+
+// check whether obs is able to import a drm format
+bool format_dmabuf_supported(uint32_t drm_format);
+
+// bytes per pixel of a drm format, 0 if unknown
+uint32_t format_bytes_per_pixel(uint32_t drm_format);
+
+// check whether pixels of a drm format can be uploaded into a texture of its obs format, possibly with red and blue swapped
+bool format_upload_supported(uint32_t drm_format, bool* swizzle);
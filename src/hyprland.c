@@ -0,0 +1,149 @@
+#include "hyprland.h"
+
+#include <obs/obs.h>
+#include <obs/util/bmem.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define HYPRLAND_MAX_MONITORS 16
+
+typedef struct {
+    char name[64];
+    hyprland_monitor monitor;
+} hyprland_monitor_entry;
+
+static hyprland_monitor_entry hyprland_monitors[HYPRLAND_MAX_MONITORS];
+static uint32_t hyprland_monitor_count = 0;
+static uint64_t hyprland_monitors_time = 0; // 0 until the first query
+static pthread_mutex_t hyprland_monitors_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// ipc socket
+
+static bool hyprland_socket_path(char* path, size_t size) {
+    const char* signature = getenv("HYPRLAND_INSTANCE_SIGNATURE");
+    if (!signature)
+        return false;
+
+    const char* runtime_dir = getenv("XDG_RUNTIME_DIR");
+    snprintf(path, size, "%s/hypr/%s/.socket.sock", runtime_dir ? runtime_dir : "/tmp", signature);
+    return access(path, F_OK) == 0;
+}
+
+static obs_data_t* hyprland_request(const char* command) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (!hyprland_socket_path(addr.sun_path, sizeof(addr.sun_path)))
+        return NULL;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return NULL;
+
+    // a stalled compositor must not stall the capture thread
+    struct timeval timeout = { .tv_sec = 0, .tv_usec = HYPRLAND_IPC_TIMEOUT_MS * 1000 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    if (connect(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0 || write(fd, command, strlen(command)) < 0) {
+        close(fd);
+        return NULL;
+    }
+
+    // read reply until the compositor closes the connection, wrapped into an object for obs_data
+    static const char prefix[] = "{\"reply\":";
+    size_t capacity = 4096, length = sizeof(prefix) - 1;
+    char* reply = bmalloc(capacity);
+    memcpy(reply, prefix, length);
+    ssize_t n;
+    while ((n = read(fd, reply + length, capacity - length - 2)) > 0) {
+        length += n;
+        if (capacity - length - 2 == 0)
+            reply = brealloc(reply, capacity *= 2);
+    }
+    close(fd);
+
+    // a timed out reply is incomplete
+    obs_data_t* data = NULL;
+    if (n == 0) {
+        reply[length++] = '}';
+        reply[length] = '\0';
+        data = obs_data_create_from_json(reply);
+    }
+    bfree(reply);
+    return data;
+}
+
+// hyprland queries
+
+bool hyprland_available() {
+    char path[108];
+    return hyprland_socket_path(path, sizeof(path));
+}
+
+static void hyprland_refresh_monitors() {
+    obs_data_t* data = hyprland_request("j/monitors");
+    if (!data)
+        return; // keep the previous layout
+
+    obs_data_array_t* monitors = obs_data_get_array(data, "reply");
+    hyprland_monitor_count = 0;
+    for (size_t i = 0; i < obs_data_array_count(monitors) && hyprland_monitor_count < HYPRLAND_MAX_MONITORS; i++) {
+        obs_data_t* item = obs_data_array_item(monitors, i);
+        hyprland_monitor_entry* entry = &hyprland_monitors[hyprland_monitor_count];
+        snprintf(entry->name, sizeof(entry->name), "%s", obs_data_get_string(item, "name"));
+        entry->monitor.x = obs_data_get_int(item, "x");
+        entry->monitor.y = obs_data_get_int(item, "y");
+        entry->monitor.scale = obs_data_get_double(item, "scale");
+        if (entry->monitor.scale > 0)
+            hyprland_monitor_count++;
+        obs_data_release(item);
+    }
+
+    obs_data_array_release(monitors);
+    obs_data_release(data);
+}
+
+bool hyprland_get_monitor(const char* name, hyprland_monitor* monitor) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t now = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+
+    // the layout is shared by all sources and queried at most once per interval
+    pthread_mutex_lock(&hyprland_monitors_mutex);
+    if (hyprland_monitors_time == 0 || now - hyprland_monitors_time >= HYPRLAND_MONITORS_INTERVAL_NS) {
+        hyprland_refresh_monitors();
+        hyprland_monitors_time = now;
+    }
+
+    bool found = false;
+    for (uint32_t i = 0; i < hyprland_monitor_count && !found; i++) {
+        if (name && strcmp(hyprland_monitors[i].name, name) == 0) {
+            *monitor = hyprland_monitors[i].monitor;
+            found = true;
+        }
+    }
+    pthread_mutex_unlock(&hyprland_monitors_mutex);
+    return found;
+}
+
+bool hyprland_get_cursor(double* x, double* y) {
+    obs_data_t* data = hyprland_request("j/cursorpos");
+    if (!data)
+        return false;
+
+    obs_data_t* reply = obs_data_get_obj(data, "reply");
+    bool valid = reply != NULL;
+    if (valid) {
+        *x = obs_data_get_double(reply, "x");
+        *y = obs_data_get_double(reply, "y");
+        obs_data_release(reply);
+    }
+
+    obs_data_release(data);
+    return valid;
+}
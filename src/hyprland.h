@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdbool.h>
+
+#define HYPRLAND_IPC_TIMEOUT_MS 100 // give up on requests the compositor does not answer
+#define HYPRLAND_MONITORS_INTERVAL_NS 1000000000ULL // the monitor layout is cached for this long
+
+typedef struct {
+    double x, y; // position in the layout
+    double scale;
+} hyprland_monitor;
+
+// check whether obs is running inside a hyprland session
+bool hyprland_available();
+
+// fetch the layout position and scale of a monitor by output name, served from a cache shared by all sources
+bool hyprland_get_monitor(const char* name, hyprland_monitor* monitor);
+
+// fetch the cursor position in layout coordinates
+bool hyprland_get_cursor(double* x, double* y);
@@ -0,0 +1,56 @@
+#include "log.h"
+
+#include <obs/util/base.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <time.h>
+
+static uint64_t log_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void log_summary(log_limit* limit, const char* source, uint64_t now) {
+    blog(limit->level, "[screencopy: %s] %u more %s in the last %.1f s", source ? source : "unnamed",
+        limit->suppressed, limit->summary, (now - limit->window_start) / 1e9);
+    limit->suppressed = 0;
+}
+
+void log_limit_init(log_limit* limit, int level, const char* summary) {
+    limit->level = level;
+    limit->summary = summary;
+    limit->window_start = 0;
+    limit->suppressed = 0;
+}
+
+void log_limited(log_limit* limit, const char* source, const char* format, ...) {
+    uint64_t now = log_now();
+    if (limit->window_start && now - limit->window_start < LOG_LIMIT_WINDOW_NS) {
+        limit->suppressed++;
+        return;
+    }
+
+    // summarize the previous window before starting a new one
+    if (limit->suppressed)
+        log_summary(limit, source, now);
+    limit->window_start = now;
+
+    char message[1024];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    blog(limit->level, "[screencopy: %s] %s", source ? source : "unnamed", message);
+}
+
+void log_limited_flush(log_limit* limit, const char* source) {
+    if (!limit->suppressed)
+        return;
+
+    uint64_t now = log_now();
+    if (now - limit->window_start >= LOG_LIMIT_WINDOW_NS) {
+        log_summary(limit, source, now);
+        limit->window_start = 0; // the next message is logged right away
+    }
+}
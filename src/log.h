@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define LOG_LIMIT_WINDOW_NS 5000000000ULL // at most one message per type and window
+
+typedef struct {
+    int level;
+    const char* summary; // what the suppressed messages are counted as, e.g. "capture failures"
+    uint64_t window_start;
+    uint32_t suppressed; // messages dropped in the current window
+} log_limit;
+
+// set up a message type, only one thread may log through it
+void log_limit_init(log_limit* limit, int level, const char* summary);
+
+// log a message tagged with the source name, unless the type was logged within the window (nothing is formatted then)
+void log_limited(log_limit* limit, const char* source, const char* format, ...);
+
+// log how many messages were dropped once the window is over, cheap to call every frame
+void log_limited_flush(log_limit* limit, const char* source);
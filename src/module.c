@@ -13,9 +13,30 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <gbm.h>
+#include <poll.h>
+#include <math.h>
+#include <sys/mman.h>
 
 #include <wlroots/wlr-screencopy-unstable-v1.h>
 #include <wayland/linux-dmabuf-unstable-v1.h>
+#include <wayland/ext-image-capture-source-v1.h>
+#include <wayland/ext-image-copy-capture-v1.h>
+#include <wayland/ext-foreign-toplevel-list-v1.h>
+#include <wayland/xdg-output-unstable-v1.h>
+
+#include "effect.h"
+#include "format.h"
+#include "damage.h"
+#include "device.h"
+#include "hyprland.h"
+#include "log.h"
+#include "probe.h"
+#include "record.h"
+#include "shm.h"
+#include "stats.h"
+#include "thread.h"
+#include "trace.h"
+#include "upload.h"
 
 OBS_DECLARE_MODULE()
 
@@ -23,83 +44,1930 @@ static void noop() {}
 
 typedef struct {
     struct wl_output* output;
-    char* name;
+    char* name; // NULL until the compositor announced it
     char* description; // (optional!)
+    int32_t x; // position in the compositor layout
+    int32_t y;
+    int32_t scale;
+    int32_t refresh; // current mode in mHz
+    int32_t mode_width; // current mode in pixels, before the transform
+    int32_t mode_height;
+    int32_t transform; // wl_output_transform the framebuffer is presented with
+
+    struct zxdg_output_v1* xdg_output; // NULL without xdg-output
+    int32_t logical_x; // area in the global compositor space, 0x0 until xdg-output reports it
+    int32_t logical_y;
+    int32_t logical_width;
+    int32_t logical_height;
+    volatile bool layout_changed; // moved or resized since the targets were placed
+    void* source; // owning source_data
 
     struct wl_list link;
 } wl_output_info;
 
 typedef struct {
-    int gbm_fd;
-    struct gbm_device* gbm;
+    double x, y; // position in the compositor layout
+    double scale; // buffer pixels per layout unit
+} output_layout;
+
+typedef struct {
+    struct ext_foreign_toplevel_handle_v1* handle;
+    char* title;
+    char* app_id;
+    char* identifier; // unique for the lifetime of the window
+    void* source; // owning source_data
+
+    struct wl_list link;
+} toplevel_info;
+
+#define MAX_CAPTURE_BUFFERS 4
+#define CURSOR_REGION_SIZE 64 // logical size of the region captured around the pointer
+#define CURSOR_REFRESH_NS 250000000ULL // a still pointer is recopied this often, its image may change without moving
+
+typedef struct {
+    struct gbm_bo* gbm_bo;
+    struct wl_buffer* wl_buffer;
+    gs_texture_t* obs_texture;
+    uint64_t size; // bytes of video memory held by the buffer object
+    bool swizzle; // imported with red and blue swapped
+    bool linear;
+    enum gs_color_space color_space;
+    uint8_t* shm_data; // shared memory buffers are mapped instead of imported
+    uint32_t shm_stride;
+} capture_buffer;
+
+typedef struct {
+    uint64_t frames; // published frames
+    uint64_t requests; // wayland requests sent, estimated by counting at the call sites
+    uint64_t objects; // wayland objects created, estimated the same way
+    uint64_t syscalls; // flushes, polls, reads and sleeps of the capture thread, without those inside libwayland or the drivers
+    uint64_t allocations; // capture buffers created
+    uint64_t uploaded_bytes; // shared memory frames transferred to the gpu
+    uint64_t unchanged_frames; // frames without damage found to be identical to the previous one
+    uint64_t cross_copies; // frames copied from the compositor gpu
+    uint64_t cross_copy_ns; // cpu time spent submitting those copies
+
+    uint64_t wakeups; // pacing sleeps of the capture thread
+    uint64_t wakeup_latency_ns; // sum of the time slept past the requested wake time
+    uint64_t wakeup_latency_max_ns;
+
+    uint64_t failures; // failed captures
+    uint64_t drops; // published frames replaced before obs rendered them
+    latency_histogram latency; // compositor presentation, or request if unknown, to publish
+    volatile double fps; // published frames per second over the last window
+    uint64_t fps_window_start;
+    uint64_t fps_window_frames;
+} capture_stats;
+
+typedef struct {
+    union {
+        struct zwlr_screencopy_frame_v1* frame; // pending frame, NULL when idle
+        struct ext_image_copy_capture_frame_v1* session_frame;
+    };
+    bool session; // frame belongs to an image copy capture session
+    bool copied;
+    bool with_damage;
+
+    uint32_t format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t flags;
+    uint32_t transform; // buffer transform reported by capture sessions
+    uint32_t shm_format; // wl_shm format, valid if shm_offered
+    uint32_t shm_stride;
+    bool shm_offered;
+    bool negotiated; // constraints of the capture session are known, dma-buf or shared memory
+    volatile bool buffer_done; // buffer parameters are known and the frame can be copied
+    volatile bool failed;
+    volatile bool ready;
+    volatile bool damaged;
+    bool unchanged; // no tile differs from the previous frame, only detected without damage
+    damage_region damage; // changed regions reported by the compositor
+    uint64_t presentation_time; // compositor timestamp of the ready frame in ns, 0 if unknown
+
+    capture_stats* stats;
+    trace_ring* trace; // NULL unless tracing is enabled
+    uint32_t trace_track;
+} screencopy_state;
+
+typedef struct {
+    struct ext_image_copy_capture_session_v1* session;
+    struct ext_image_capture_source_v1* source;
+    void* target; // captured output or toplevel info
+    bool paint_cursors;
+    volatile bool stopped;
+
+    uint32_t width; // constraints are collected until done and then applied to the state
+    uint32_t height;
+    uint32_t format;
+    uint32_t shm_format;
+    bool shm_offered;
+    screencopy_state* state;
+} capture_session;
+
+typedef enum {
+    CAPTURE_OUTPUT,
+    CAPTURE_WINDOW, // single toplevel, requires capture sessions
+    CAPTURE_DESKTOP, // all enabled outputs composited by their layout
+    CAPTURE_REPLAY // recorded frames fed through the capture thread, works without a compositor
+} capture_type;
+
+#define MAX_CAPTURE_TARGETS 8
+#define TRACE_RING_CAPACITY 65536 // events kept for export, about 2 MiB
+#define CAPTURE_CONNECT_TIMEOUT_NS 5000000000ULL // give up on a compositor that does not answer while connecting
+
+typedef struct {
+    struct wl_output* output; // NULL when capturing a window
+    wl_output_info* info;
+    double scale;
+
+    screencopy_state frame;
+    capture_session session;
+
+    capture_buffer buffers[MAX_CAPTURE_BUFFERS];
+    uint32_t buffer_count;
+    uint32_t buffer_index;
+    uint32_t buffer_width;
+    uint32_t buffer_height;
+    uint32_t buffer_format; // drm format, also for shared memory buffers
+    bool buffer_shm;
+    bool shm_imported; // shared memory slots are sampled by obs where the compositor wrote them, without uploads
+    shm_pool shm; // shared memory of all buffers in the ring
+    upload_texture upload; // frame the shared memory buffers are uploaded into, unless the slots are imported
+    gs_texture_t* local_texture; // device local copy of frames captured on another gpu
+    uint64_t local_size; // budget held by the textures besides the buffers, returned with them
+    uint64_t upload_size;
+    uint64_t scaled_size;
+
+    gs_texture_t* volatile obs_texture;
+    volatile uint64_t obs_frame; // counts published frames
+    gs_texrender_t* scaled; // downscaled copy of the published frame, NULL at full size
+    gs_texture_t* scaled_source;
+    uint64_t scaled_frame;
+    volatile bool obs_swizzle;
+    volatile uint32_t obs_flip;
+    volatile uint32_t obs_transform; // buffer transform undone in the draw
+    volatile enum gs_color_space obs_color_space;
+    volatile int32_t x; // placement in the composited frame in pixels
+    volatile int32_t y;
+    volatile uint32_t width;
+    volatile uint32_t height;
+} capture_target;
+
+typedef enum {
+    CURSOR_HIDDEN,
+    CURSOR_EMBEDDED, // drawn into the output frame, every pointer move recopies the frame
+    CURSOR_SEPARATE // captured as a small region around the pointer and composited on render
+} cursor_mode;
+
+typedef enum {
+    RATE_OBS, // obs frame interval
+    RATE_OUTPUT, // refresh rate of the captured output
+    RATE_CUSTOM
+} capture_rate;
+
+typedef enum {
+    BUFFER_AUTO, // dma-buf, shared memory if the compositor offers no dma-buf format
+    BUFFER_DMABUF,
+    BUFFER_SHM
+} buffer_type;
+
+typedef enum {
+    CROSS_GPU_AUTO, // when the compositor renders on another gpu than the gbm device
+    CROSS_GPU_OFF,
+    CROSS_GPU_ALWAYS
+} cross_gpu_mode;
+
+typedef enum {
+    TRANSFER_AUTO, // srgb, or linear for floating point formats
+    TRANSFER_SRGB,
+    TRANSFER_PQ,
+    TRANSFER_HLG,
+    TRANSFER_LINEAR // scrgb, 1.0 is 80 nits
+} transfer_function;
+
+typedef struct {
+    obs_source_t* source;
+    struct gbm_device* gbm; // shared with every source on the same render node
+    struct gbm_device* cross_gbm; // compositor gpu, buffers are allocated there when capturing across gpus
+    cross_gpu_mode cross_gpu_mode;
+    bool cross_gpu; // frames are imported from linear buffers and copied into a local texture
+    dev_t compositor_device; // main device from the dma-buf feedback, 0 if unknown
+    struct zwp_linux_dmabuf_feedback_v1* dmabuf_feedback;
+    char* connect_gbm_device; // connection settings, used by the capture thread to connect
+    char* connect_display;
+    bool connect_required; // replays also run without a compositor
+    volatile bool connect_synced;
+    volatile bool connected; // globals are bound and outputs are known
+    const char* volatile connect_error; // reason the last attempt failed, retried with backoff until connected
     struct wl_display* wl;
+    struct wl_registry* registry;
 
-    struct wl_list outputs;
+    struct wl_list outputs; // updated on the capture thread
+    pthread_mutex_t outputs_mutex;
     struct zwlr_screencopy_manager_v1* screencopy_manager;
     struct zwp_linux_dmabuf_v1* linux_dmabuf;
+    struct wl_shm* shm;
+    struct zxdg_output_manager_v1* xdg_output_manager;
+    struct ext_image_copy_capture_manager_v1* copy_capture_manager;
+    struct ext_output_image_capture_source_manager_v1* output_source_manager;
+    struct ext_foreign_toplevel_image_capture_source_manager_v1* toplevel_source_manager;
+    struct ext_foreign_toplevel_list_v1* toplevel_list;
+    struct wl_seat* seat;
+    struct wl_pointer* pointer; // followed by cursor sessions, NULL if the seat has none
+    bool capture_sessions; // capture through ext-image-copy-capture instead of wlr-screencopy
+
+    probe_result probe; // capabilities of the compositor, the fastest candidate is used for automatic buffers
+    char probe_key[256];
+    bool probe_pending; // the probe of the display is not known to this source yet
+    int32_t probe_candidate; // candidate being measured, -1 unless this source probes the display
+    uint32_t probe_frames;
+    uint64_t probe_latency_ns;
+    uint64_t probe_start; // first capture of the candidate
+
+    struct wl_list toplevels; // updated on the capture thread
+    pthread_mutex_t toplevels_mutex;
 
     pthread_t capture_thread;
+    thread_options capture_thread_options;
 
     volatile bool capture_stopsignal;
+    volatile bool capture_wakeup; // interrupts the sleep between frames
+    volatile bool capture_live; // shown in program
+    volatile bool thumbnail_tier; // capture slowly and draw small while not in program
+    volatile capture_type capture_type;
     struct wl_output* capture_output;
+    const char* capture_output_name;
+    toplevel_info* volatile capture_toplevel;
+    char* capture_app_id; // window to pick up again when it is reopened
+
+    wl_output_info* capture_outputs[MAX_CAPTURE_TARGETS]; // requested by the settings, applied on the capture thread
+    uint32_t capture_output_count;
+    bool capture_outputs_changed;
+    pthread_mutex_t capture_outputs_mutex;
+
+    capture_target targets[MAX_CAPTURE_TARGETS];
+    volatile uint32_t target_count;
+    double target_scale; // largest output scale, outputs with smaller scales are upscaled
+    bool target_row; // layout unknown, outputs are placed next to each other
+    volatile uint32_t width; // extent of the composited frame
+    volatile uint32_t height;
+
+    uint32_t buffer_count_requested;
+    buffer_type buffer_type;
+    uint64_t vram_budget; // budget for all sources combined, 0 = unlimited
+    volatile uint64_t vram_usage;
+    bool vram_starved; // no buffer fit into the budget, counted in vram_starved_sources
 
-    uint32_t screencopy_frame_format;
-    uint32_t screencopy_frame_width;
-    uint32_t screencopy_frame_height;
-    volatile bool screencopy_frame_failed;
-
-    gs_texture_t* obs_texture;
     enum gs_color_space obs_color_space;
-
+    volatile bool obs_linear;
+    volatile transfer_function transfer;
+    volatile uint32_t capture_scale; // percent of the captured size frames are downscaled to
+
+    volatile cursor_mode cursor_mode;
+    screencopy_state cursor_frame;
+    capture_buffer cursor_buffers[2];
+    uint32_t cursor_buffer_index;
+    int32_t cursor_region_x; // requested region in output logical coordinates
+    int32_t cursor_region_y;
+    output_layout cursor_monitor; // layout of the captured output, scale 0 if unknown
+    double cursor_pointer_x; // pointer position of the last region copy
+    double cursor_pointer_y;
+    uint64_t cursor_copied_time;
+
+    struct ext_image_copy_capture_cursor_session_v1* cursor_session; // pointer of the captured output, NULL when following the hyprland pointer
+    capture_session cursor_capture; // copies of the cursor image, only completed when the image changes
+    bool cursor_entered; // the pointer is inside the captured output
+    volatile bool cursor_moved; // position or hotspot changed since the cursor was published
+    int32_t cursor_position_x; // pointer in buffer coordinates of the output
+    int32_t cursor_position_y;
+    int32_t cursor_hotspot_x; // pointer in the cursor image
+    int32_t cursor_hotspot_y;
+    gs_texture_t* cursor_image; // last copied cursor image, moved with the pointer
+    uint32_t cursor_image_width;
+    uint32_t cursor_image_height;
+
+    gs_texture_t* volatile cursor_texture;
+    volatile int32_t cursor_x; // published region in upright frame pixels
+    volatile int32_t cursor_y;
+    volatile bool cursor_swizzle;
+    volatile uint32_t cursor_flip;
+    volatile uint32_t cursor_transform; // buffer transform of the region, undone in the draw like the output frames
+
+    char* record_path; // record the captured frames of single targets, NULL when not recording
+    record_writer* recorder;
+    char* replay_path; // requested by the settings, opened on the capture thread
+    record_reader* replay;
+    uint8_t* replay_image; // frame reconstructed from the damage of all replayed frames
+    uint64_t replay_index;
+    uint64_t replay_start;
+
+    capture_stats stats;
+    volatile uint64_t rendered_frame; // last published frame drawn by obs
+    bool stats_served;
+    trace_ring* trace; // per-frame event timeline, NULL unless enabled
+    char* trace_directory;
+
+    log_limit log_failures; // messages of the capture thread, limited per type
+    log_limit log_recoveries;
+    log_limit log_buffers;
+    log_limit log_slow_frames;
+    log_limit log_updates; // settings changes, sent on every step of a slider
+
+    volatile capture_rate capture_rate;
     uint64_t frame_duration_ns;
+    uint32_t capture_failures; // consecutive failed frames
+    uint32_t capture_static_frames; // consecutive frames without damage
 } source_data;
 
 // screencopy frame
 
 static void screencopy_frame_linux_dmabuf(void* _, struct zwlr_screencopy_frame_v1* frame, uint32_t format, uint32_t width, uint32_t height) {
+    screencopy_state* state = (screencopy_state*) _;
+    state->format = format;
+    state->width = width;
+    state->height = height;
+}
+
+static void screencopy_frame_buffer(void* _, struct zwlr_screencopy_frame_v1* frame, uint32_t format, uint32_t width, uint32_t height, uint32_t stride) {
+    screencopy_state* state = (screencopy_state*) _;
+    state->shm_format = format;
+    state->shm_stride = stride;
+    state->shm_offered = true;
+    state->width = width;
+    state->height = height;
+
+    // before v3 there is no buffer_done, the shared memory buffer is the only one offered
+    if (zwlr_screencopy_frame_v1_get_version(frame) < ZWLR_SCREENCOPY_FRAME_V1_BUFFER_DONE_SINCE_VERSION) {
+        state->buffer_done = true;
+        trace_record(state->trace, state->trace_track, TRACE_BUFFER_DONE, 0);
+    }
+}
+
+static void screencopy_frame_flags(void* _, struct zwlr_screencopy_frame_v1* frame, uint32_t flags) {
+    screencopy_state* state = (screencopy_state*) _;
+    state->flags = flags;
+}
+
+static void screencopy_frame_damage(void* _, struct zwlr_screencopy_frame_v1* frame, uint32_t x, uint32_t y, uint32_t width, uint32_t height) {
+    screencopy_state* state = (screencopy_state*) _;
+    if (width && height)
+        state->damaged = true;
+    damage_region_add(&state->damage, x, y, width, height, state->width, state->height);
+}
+
+static void screencopy_frame_ready(void* _, struct zwlr_screencopy_frame_v1* frame, uint32_t tv_sec_hi, uint32_t tv_sec_lo, uint32_t tv_nsec) {
+    screencopy_state* state = (screencopy_state*) _;
+    state->presentation_time = ((((uint64_t) tv_sec_hi << 32) | tv_sec_lo) * 1000000000ULL) + tv_nsec;
+    state->failed = false;
+    state->ready = true;
+    trace_record(state->trace, state->trace_track, TRACE_READY, state->presentation_time);
+}
+
+static void screencopy_frame_failed(void* _, struct zwlr_screencopy_frame_v1* frame) {
+    screencopy_state* state = (screencopy_state*) _;
+    state->failed = true;
+    state->ready = true;
+    trace_record(state->trace, state->trace_track, TRACE_FAILED, 0);
+}
+
+static void screencopy_frame_buffer_done(void* _, struct zwlr_screencopy_frame_v1* frame) {
+    screencopy_state* state = (screencopy_state*) _;
+    state->buffer_done = true;
+    trace_record(state->trace, state->trace_track, TRACE_BUFFER_DONE, 0);
+}
+
+static struct zwlr_screencopy_frame_v1_listener screencopy_frame_listener = {
+    .buffer = screencopy_frame_buffer,
+    .flags = screencopy_frame_flags,
+    .ready = screencopy_frame_ready,
+    .failed = screencopy_frame_failed,
+    .damage = screencopy_frame_damage,
+    .linux_dmabuf = screencopy_frame_linux_dmabuf,
+    .buffer_done = screencopy_frame_buffer_done
+};
+
+// capture session frame
+
+static void capture_frame_transform(void* _, struct ext_image_copy_capture_frame_v1* frame, uint32_t transform) {
+    screencopy_state* state = (screencopy_state*) _;
+    state->transform = transform;
+}
+
+static void capture_frame_damage(void* _, struct ext_image_copy_capture_frame_v1* frame, int32_t x, int32_t y, int32_t width, int32_t height) {
+    screencopy_state* state = (screencopy_state*) _;
+    if (width > 0 && height > 0)
+        state->damaged = true;
+    damage_region_add(&state->damage, x, y, width, height, state->width, state->height);
+}
+
+static void capture_frame_presentation_time(void* _, struct ext_image_copy_capture_frame_v1* frame, uint32_t tv_sec_hi, uint32_t tv_sec_lo, uint32_t tv_nsec) {
+    screencopy_state* state = (screencopy_state*) _;
+    state->presentation_time = ((((uint64_t) tv_sec_hi << 32) | tv_sec_lo) * 1000000000ULL) + tv_nsec;
+}
+
+static void capture_frame_ready(void* _, struct ext_image_copy_capture_frame_v1* frame) {
+    screencopy_state* state = (screencopy_state*) _;
+    state->failed = false;
+    state->ready = true;
+    trace_record(state->trace, state->trace_track, TRACE_READY, state->presentation_time);
+}
+
+static void capture_frame_failed(void* _, struct ext_image_copy_capture_frame_v1* frame, uint32_t reason) {
+    screencopy_state* state = (screencopy_state*) _;
+    state->failed = true;
+    state->ready = true;
+    trace_record(state->trace, state->trace_track, TRACE_FAILED, 0);
+}
+
+static struct ext_image_copy_capture_frame_v1_listener capture_frame_listener = {
+    .transform = capture_frame_transform,
+    .damage = capture_frame_damage,
+    .presentation_time = capture_frame_presentation_time,
+    .ready = capture_frame_ready,
+    .failed = capture_frame_failed
+};
+
+// frame state
+
+static void screencopy_state_reset(screencopy_state* state) {
+    state->copied = false;
+    state->flags = 0;
+    state->transform = WL_OUTPUT_TRANSFORM_NORMAL;
+    state->buffer_done = false;
+    state->failed = false;
+    state->ready = false;
+    state->damaged = false;
+    state->unchanged = false;
+    state->damage.count = 0;
+    state->presentation_time = 0;
+}
+
+static void screencopy_state_begin(screencopy_state* state, struct zwlr_screencopy_frame_v1* frame) {
+    state->frame = frame;
+    state->session = false;
+    screencopy_state_reset(state);
+    zwlr_screencopy_frame_v1_add_listener(frame, &screencopy_frame_listener, state);
+    state->stats->requests++;
+    state->stats->objects++;
+    trace_record(state->trace, state->trace_track, TRACE_REQUEST, 0);
+}
+
+static void screencopy_state_begin_session(screencopy_state* state, struct ext_image_copy_capture_frame_v1* frame) {
+    state->session_frame = frame;
+    state->session = true;
+    screencopy_state_reset(state);
+    state->buffer_done = state->negotiated; // negotiated once per session
+    ext_image_copy_capture_frame_v1_add_listener(frame, &capture_frame_listener, state);
+    state->stats->requests++;
+    state->stats->objects++;
+    trace_record(state->trace, state->trace_track, TRACE_REQUEST, 0);
+}
+
+static void screencopy_state_copy(screencopy_state* state, struct wl_buffer* buffer, bool wait_damage) {
+    // sessions only capture once the source is damaged, except for the first frame
+    if (state->session) {
+        state->with_damage = true;
+        ext_image_copy_capture_frame_v1_attach_buffer(state->session_frame, buffer);
+        ext_image_copy_capture_frame_v1_damage_buffer(state->session_frame, 0, 0, state->width, state->height);
+        ext_image_copy_capture_frame_v1_capture(state->session_frame);
+        state->copied = true;
+        state->stats->requests += 3;
+        trace_record(state->trace, state->trace_track, TRACE_COPY, 0);
+        return;
+    }
+
+    // with damage the compositor holds the copy until something changed
+    state->with_damage = wait_damage && zwlr_screencopy_frame_v1_get_version(state->frame) >= ZWLR_SCREENCOPY_FRAME_V1_COPY_WITH_DAMAGE_SINCE_VERSION;
+    if (state->with_damage)
+        zwlr_screencopy_frame_v1_copy_with_damage(state->frame, buffer);
+    else
+        zwlr_screencopy_frame_v1_copy(state->frame, buffer);
+    state->copied = true;
+    state->stats->requests++;
+    trace_record(state->trace, state->trace_track, TRACE_COPY, 0);
+}
+
+static void screencopy_state_end(screencopy_state* state) {
+    if (state->session)
+        ext_image_copy_capture_frame_v1_destroy(state->session_frame);
+    else
+        zwlr_screencopy_frame_v1_destroy(state->frame);
+    state->frame = NULL;
+    state->stats->requests++;
+}
+
+// capture session
+
+static void capture_session_buffer_size(void* _, struct ext_image_copy_capture_session_v1* session, uint32_t width, uint32_t height) {
+    capture_session* capture = (capture_session*) _;
+    capture->width = width;
+    capture->height = height;
+}
+
+static void capture_session_dmabuf_format(void* _, struct ext_image_copy_capture_session_v1* session, uint32_t format, struct wl_array* modifiers) {
+    capture_session* capture = (capture_session*) _;
+    // prefer formats with a known color format
+    if (capture->format == 0 || (!format_lookup(capture->format) && format_lookup(format)))
+        capture->format = format;
+}
+
+static void capture_session_shm_format(void* _, struct ext_image_copy_capture_session_v1* session, uint32_t format) {
+    // prefer formats that can be uploaded without conversion
+    capture_session* capture = (capture_session*) _;
+    bool swizzle;
+    if (!capture->shm_offered || (!format_upload_supported(shm_format_to_drm(capture->shm_format), &swizzle) && format_upload_supported(shm_format_to_drm(format), &swizzle))) {
+        capture->shm_format = format;
+        capture->shm_offered = true;
+    }
+}
+
+static void capture_session_done(void* _, struct ext_image_copy_capture_session_v1* session) {
+    capture_session* capture = (capture_session*) _;
+    capture->state->width = capture->width;
+    capture->state->height = capture->height;
+    capture->state->format = capture->format;
+    capture->state->shm_format = capture->shm_format;
+    capture->state->shm_stride = shm_stride_align(capture->width, format_bytes_per_pixel(shm_format_to_drm(capture->shm_format)));
+    capture->state->shm_offered = capture->shm_offered;
+    capture->state->negotiated = true;
+    capture->state->buffer_done = true;
+    capture->format = 0;
+    capture->shm_offered = false;
+    trace_record(capture->state->trace, capture->state->trace_track, TRACE_BUFFER_DONE, 0);
+}
+
+static void capture_session_stopped(void* _, struct ext_image_copy_capture_session_v1* session) {
+    capture_session* capture = (capture_session*) _;
+    capture->stopped = true;
+}
+
+static struct ext_image_copy_capture_session_v1_listener capture_session_listener = {
+    .buffer_size = capture_session_buffer_size,
+    .shm_format = capture_session_shm_format,
+    .dmabuf_device = noop,
+    .dmabuf_format = capture_session_dmabuf_format,
+    .done = capture_session_done,
+    .stopped = capture_session_stopped
+};
+
+static void capture_session_listen(capture_session* capture, screencopy_state* state, void* target, bool paint_cursors) {
+    capture->target = target;
+    capture->paint_cursors = paint_cursors;
+    capture->stopped = false;
+    capture->format = 0;
+    capture->shm_offered = false;
+    capture->state = state;
+    state->format = 0; // not capturable until the constraints are done
+    state->shm_offered = false;
+    state->negotiated = false;
+    ext_image_copy_capture_session_v1_add_listener(capture->session, &capture_session_listener, capture);
+    state->stats->requests += 2;
+    state->stats->objects += 2;
+}
+
+static void capture_session_create(source_data* data, capture_session* capture, screencopy_state* state, capture_type type, void* target, bool paint_cursors) {
+    if (type == CAPTURE_WINDOW)
+        capture->source = ext_foreign_toplevel_image_capture_source_manager_v1_create_source(data->toplevel_source_manager, ((toplevel_info*) target)->handle);
+    else
+        capture->source = ext_output_image_capture_source_manager_v1_create_source(data->output_source_manager, (struct wl_output*) target);
+    capture->session = ext_image_copy_capture_manager_v1_create_session(data->copy_capture_manager, capture->source,
+        paint_cursors ? EXT_IMAGE_COPY_CAPTURE_MANAGER_V1_OPTIONS_PAINT_CURSORS : 0);
+    capture_session_listen(capture, state, target, paint_cursors);
+}
+
+static void capture_session_destroy(capture_session* capture) {
+    ext_image_copy_capture_session_v1_destroy(capture->session);
+    ext_image_capture_source_v1_destroy(capture->source);
+    capture->state->stats->requests += 2;
+    capture->session = NULL;
+    capture->source = NULL;
+}
+
+// capture buffers
+
+static volatile uint64_t vram_usage_total = 0; // bytes held by capture buffers and textures of all sources
+static volatile uint32_t vram_starved_sources = 0; // sources without any buffer, the others shrink their rings to make room
+
+static uint64_t capture_buffer_size(struct gbm_bo* gbm_bo) {
+    uint64_t size = 0;
+    int planes = gbm_bo_get_plane_count(gbm_bo);
+    for (int i = 0; i < planes; i++)
+        size += (uint64_t) gbm_bo_get_stride_for_plane(gbm_bo, i) * gbm_bo_get_height(gbm_bo);
+    return size;
+}
+
+// account buffer memory, checked against the budget and added in one step so racing sources cannot both take the last bytes
+static bool capture_buffer_reserve(source_data* data, uint64_t size) {
+    uint64_t total = __atomic_load_n(&vram_usage_total, __ATOMIC_RELAXED);
+    do {
+        if (data->vram_budget && total + size > data->vram_budget)
+            return false;
+    } while (!__atomic_compare_exchange_n(&vram_usage_total, &total, total + size, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    __atomic_add_fetch(&data->vram_usage, size, __ATOMIC_RELAXED);
+    return true;
+}
+
+static void capture_buffer_unreserve(source_data* data, uint64_t size) {
+    __atomic_sub_fetch(&data->vram_usage, size, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&vram_usage_total, size, __ATOMIC_RELAXED);
+}
+
+static void capture_buffer_destroy(source_data* data, capture_buffer* buffer);
+static void capture_buffers_release(source_data* data, capture_target* target, uint32_t count);
+static bool capture_buffer_create(source_data* data, capture_buffer* buffer, uint32_t width, uint32_t height, uint32_t format) {
+    // buffers shared between gpus are linear, the only layout both are guaranteed to understand
+    struct gbm_device* gbm = data->cross_gbm ? data->cross_gbm : data->gbm;
+    buffer->gbm_bo = gbm_bo_create(gbm, width, height, format, GBM_BO_USE_RENDERING | (data->cross_gpu ? GBM_BO_USE_LINEAR : 0));
+    if (buffer->gbm_bo == NULL) {
+        log_limited(&data->log_failures, obs_source_get_name(data->source), "Failed to create GBM buffer object");
+        return false;
+    }
+
+    // enforce vram budget, the reservation is returned when the buffer is destroyed
+    uint64_t size = capture_buffer_size(buffer->gbm_bo);
+    if (!capture_buffer_reserve(data, size)) {
+        gbm_bo_destroy(buffer->gbm_bo);
+        buffer->gbm_bo = NULL;
+        return false;
+    }
+    buffer->size = size;
+
+    int32_t fd = gbm_bo_get_fd_for_plane(buffer->gbm_bo, 0);
+    uint32_t offset = gbm_bo_get_offset(buffer->gbm_bo, 0);
+    uint32_t stride = gbm_bo_get_stride_for_plane(buffer->gbm_bo, 0);
+    uint64_t modifier = gbm_bo_get_modifier(buffer->gbm_bo);
+
+    // create wl_buffer
+    struct zwp_linux_buffer_params_v1* params = zwp_linux_dmabuf_v1_create_params(data->linux_dmabuf);
+    zwp_linux_buffer_params_v1_add(params,
+        fd,
+        0,
+        offset,
+        stride,
+        modifier >> 32,
+        modifier & 0xFFFFFFFF
+    );
+    buffer->wl_buffer = zwp_linux_buffer_params_v1_create_immed(params, width, height, format, 0);
+    zwp_linux_buffer_params_v1_destroy(params);
+
+    // find fitting color format, importing with red and blue swapped if the driver lacks the format
+    const format_info* info = format_lookup(format);
+    enum gs_color_format color_format = info ? info->color_format : GS_BGRX;
+    buffer->color_space = info ? info->color_space : GS_CS_SRGB;
+    buffer->linear = info && info->linear;
+
+    uint32_t import_format = format;
+    if (info && info->swapped_format && !format_dmabuf_supported(format) && format_dmabuf_supported(info->swapped_format)) {
+        import_format = info->swapped_format;
+        buffer->swizzle = true;
+    }
+
+    // create obs texture
+    obs_enter_graphics();
+    buffer->obs_texture = gs_texture_create_from_dmabuf(
+        width,
+        height,
+        import_format,
+        color_format,
+        1,
+        &fd,
+        &stride,
+        &offset,
+        &modifier
+    );
+    obs_leave_graphics();
+    close(fd);
+
+    // return the reservation of buffers obs is unable to import
+    if (!buffer->obs_texture) {
+        log_limited(&data->log_failures, obs_source_get_name(data->source), "Failed to import DMA-BUF into OBS");
+        obs_enter_graphics();
+        capture_buffer_destroy(data, buffer);
+        obs_leave_graphics();
+        return false;
+    }
+
+    data->stats.allocations++;
+    return true;
+}
+
+static void capture_buffer_destroy(source_data* data, capture_buffer* buffer) {
+    // replay buffers are plain textures
+    if (buffer->gbm_bo)
+        gbm_bo_destroy(buffer->gbm_bo);
+    if (buffer->wl_buffer)
+        wl_buffer_destroy(buffer->wl_buffer);
+    gs_texture_destroy(buffer->obs_texture);
+    capture_buffer_unreserve(data, buffer->size);
+    memset(buffer, 0, sizeof(capture_buffer));
+}
+
+static bool capture_buffer_import_shm(source_data* data, capture_target* target, capture_buffer* buffer, size_t offset, size_t size) {
+    // the slot becomes a linear dma-buf of system memory, obs samples it without any copy
+    int32_t fd = shm_pool_export_dmabuf(&target->shm, offset, size);
+    if (fd < 0)
+        return false;
+
+    // import with red and blue swapped if the driver lacks the format
+    const format_info* info = format_lookup(target->buffer_format);
+    uint32_t import_format = target->buffer_format;
+    buffer->swizzle = false;
+    if (!format_dmabuf_supported(import_format) && info->swapped_format && format_dmabuf_supported(info->swapped_format)) {
+        import_format = info->swapped_format;
+        buffer->swizzle = true;
+    }
+
+    uint32_t stride = buffer->shm_stride, plane_offset = 0;
+    uint64_t modifier = SHM_DMABUF_MODIFIER;
+    obs_enter_graphics();
+    buffer->obs_texture = gs_texture_create_from_dmabuf(target->buffer_width, target->buffer_height, import_format, info->color_format,
+        1, &fd, &stride, &plane_offset, &modifier);
+    obs_leave_graphics();
+    close(fd);
+    return buffer->obs_texture != NULL;
+}
+
+static void capture_buffers_allocate_shm(source_data* data, capture_target* target, uint32_t stride) {
+    const format_info* info = format_lookup(target->buffer_format);
+    uint32_t bpp = format_bytes_per_pixel(target->buffer_format);
+    bool swizzle;
+    if (!info || !format_upload_supported(target->buffer_format, &swizzle) || stride < target->buffer_width * bpp) {
+        log_limited(&data->log_failures, obs_source_get_name(data->source), "Unable to upload shared memory format %.4s", (const char*) &target->buffer_format);
+        return;
+    }
+
+    // one pool holds the whole ring, slots start on pages so each can be exported as a dma-buf of its own
+    size_t slot_size = shm_slot_size(stride, target->buffer_height);
+    if (!shm_pool_create(&target->shm, data->shm, slot_size * data->buffer_count_requested))
+        return;
+
+    target->shm_imported = true;
+    while (target->buffer_count < data->buffer_count_requested) {
+        capture_buffer* buffer = &target->buffers[target->buffer_count];
+        buffer->wl_buffer = wl_shm_pool_create_buffer(target->shm.pool, slot_size * target->buffer_count,
+            target->buffer_width, target->buffer_height, stride, shm_format_from_drm(target->buffer_format));
+        buffer->shm_data = target->shm.data + slot_size * target->buffer_count;
+        buffer->shm_stride = stride;
+        buffer->linear = info->linear;
+        buffer->color_space = info->color_space;
+        target->shm_imported &= capture_buffer_import_shm(data, target, buffer, slot_size * target->buffer_count, slot_size);
+        data->stats.allocations++;
+        data->stats.objects++;
+        target->buffer_count++;
+    }
+    if (target->shm_imported)
+        return;
+
+    // without udmabuf the frames are uploaded into a persistent texture and its staging strip, which count against the budget
+    obs_enter_graphics();
+    for (uint32_t i = 0; i < target->buffer_count; i++) {
+        gs_texture_destroy(target->buffers[i].obs_texture);
+        target->buffers[i].obs_texture = NULL;
+        target->buffers[i].swizzle = swizzle;
+    }
+    uint64_t size = ((uint64_t) target->buffer_width * target->buffer_height + UPLOAD_TILE_SIZE * UPLOAD_STRIP_TILES * UPLOAD_TILE_SIZE) * bpp;
+    bool created = capture_buffer_reserve(data, size);
+    if (created && upload_texture_create(&target->upload, target->buffer_width, target->buffer_height, info->color_format, bpp))
+        target->upload_size = size;
+    else if (created)
+        capture_buffer_unreserve(data, size);
+    obs_leave_graphics();
+    if (!target->upload_size)
+        capture_buffers_release(data, target, target->buffer_count);
+}
+
+static void capture_buffers_starved(source_data* data, bool starved) {
+    // other sources give up buffers beyond their first while any source has none
+    if (data->vram_starved == starved)
+        return;
+    data->vram_starved = starved;
+    if (starved)
+        __atomic_add_fetch(&vram_starved_sources, 1, __ATOMIC_RELAXED);
+    else
+        __atomic_sub_fetch(&vram_starved_sources, 1, __ATOMIC_RELAXED);
+}
+
+static void capture_buffers_allocate(source_data* data, capture_target* target, bool shm) {
+    target->buffer_width = target->frame.width;
+    target->buffer_height = target->frame.height;
+    target->buffer_format = shm ? shm_format_to_drm(target->frame.shm_format) : target->frame.format;
+    target->buffer_shm = shm;
+
+    if (shm)
+        capture_buffers_allocate_shm(data, target, target->frame.shm_stride);
+    while (!shm && target->buffer_count < data->buffer_count_requested) {
+        if (!capture_buffer_create(data, &target->buffers[target->buffer_count], target->buffer_width, target->buffer_height, target->buffer_format))
+            break;
+
+        target->buffer_count++;
+    }
+
+    capture_buffers_starved(data, target->buffer_count == 0 && data->vram_budget);
+    if (target->buffer_count == 0) {
+        log_limited(&data->log_failures, obs_source_get_name(data->source), "Failed to allocate capture buffers (VRAM budget: %lu MiB, in use: %lu MiB)",
+            data->vram_budget >> 20, vram_usage_total >> 20);
+        return;
+    }
+
+    log_limited(&data->log_buffers, obs_source_get_name(data->source), "Allocated %u %s capture buffers for %ux%u frames (source: %.1f MiB, all sources: %.1f MiB)",
+        target->buffer_count, !shm ? "DMA-BUF" : target->shm_imported ? "shared memory (imported without copies)" : "shared memory", target->buffer_width, target->buffer_height,
+        data->vram_usage / 1048576.0, vram_usage_total / 1048576.0);
+}
+
+static void capture_buffers_release(source_data* data, capture_target* target, uint32_t count) {
+    obs_enter_graphics();
+    while (count-- > 0 && target->buffer_count > 0) {
+        capture_buffer* buffer = &target->buffers[--target->buffer_count];
+
+        // keep the published buffer alive when shrinking the ring
+        if (buffer->obs_texture == target->obs_texture && target->buffer_count > 0) {
+            capture_buffer published = *buffer;
+            *buffer = target->buffers[0];
+            target->buffers[0] = published;
+        }
+
+        if (buffer->obs_texture == target->obs_texture)
+            target->obs_texture = NULL;
+
+        capture_buffer_destroy(data, buffer);
+    }
+
+    // shared memory and the upload texture belong to the whole ring
+    if (target->buffer_count == 0 && target->upload.texture) {
+        if (target->obs_texture == target->upload.texture)
+            target->obs_texture = NULL;
+        upload_texture_destroy(&target->upload);
+    }
+    if (target->buffer_count == 0 && target->local_texture) {
+        if (target->obs_texture == target->local_texture)
+            target->obs_texture = NULL;
+        gs_texture_destroy(target->local_texture);
+        target->local_texture = NULL;
+    }
+    if (target->buffer_count == 0) {
+        gs_texrender_destroy(target->scaled);
+        target->scaled = NULL;
+        target->scaled_source = NULL;
+        capture_buffer_unreserve(data, target->local_size + target->upload_size + target->scaled_size);
+        target->local_size = 0;
+        target->upload_size = 0;
+        target->scaled_size = 0;
+    }
+    obs_leave_graphics();
+    if (target->buffer_count == 0) {
+        shm_pool_destroy(&target->shm);
+        target->shm_imported = false;
+    }
+
+    // continue after the published buffer
+    target->buffer_index = 0;
+    for (uint32_t i = 0; i < target->buffer_count; i++)
+        if (target->buffers[i].obs_texture == target->obs_texture)
+            target->buffer_index = (i + 1) % target->buffer_count;
+}
+
+// cursor capture
+
+static void cursor_release(source_data* data) {
+    obs_enter_graphics();
+    data->cursor_texture = NULL;
+    data->cursor_image = NULL;
+    for (int i = 0; i < 2; i++)
+        if (data->cursor_buffers[i].gbm_bo)
+            capture_buffer_destroy(data, &data->cursor_buffers[i]);
+    obs_leave_graphics();
+}
+
+static output_layout wl_output_info_layout(wl_output_info* info) {
+    if (info->logical_width <= 0 || info->mode_width <= 0)
+        return (output_layout) { info->x, info->y, info->scale > 0 ? info->scale : 1 };
+
+    // the logical size is upright, fractional scales are only known from it
+    bool rotated = info->transform & WL_OUTPUT_TRANSFORM_90;
+    return (output_layout) { info->logical_x, info->logical_y, (double) (rotated ? info->mode_height : info->mode_width) / info->logical_width };
+}
+
+// cursor sessions
+
+static void cursor_session_enter(void* _, struct ext_image_copy_capture_cursor_session_v1* session) {
     source_data* data = (source_data*) _;
-    data->screencopy_frame_format = format;
-    data->screencopy_frame_width = width;
-    data->screencopy_frame_height = height;
+    data->cursor_entered = true;
+    data->cursor_moved = true;
+}
+
+static void cursor_session_leave(void* _, struct ext_image_copy_capture_cursor_session_v1* session) {
+    source_data* data = (source_data*) _;
+    data->cursor_entered = false;
+    data->cursor_moved = true;
+}
+
+static void cursor_session_position(void* _, struct ext_image_copy_capture_cursor_session_v1* session, int32_t x, int32_t y) {
+    source_data* data = (source_data*) _;
+    data->cursor_position_x = x;
+    data->cursor_position_y = y;
+    data->cursor_moved = true;
+}
+
+static void cursor_session_hotspot(void* _, struct ext_image_copy_capture_cursor_session_v1* session, int32_t x, int32_t y) {
+    source_data* data = (source_data*) _;
+    data->cursor_hotspot_x = x;
+    data->cursor_hotspot_y = y;
+    data->cursor_moved = true;
+}
+
+static struct ext_image_copy_capture_cursor_session_v1_listener cursor_session_listener = {
+    .enter = cursor_session_enter,
+    .leave = cursor_session_leave,
+    .position = cursor_session_position,
+    .hotspot = cursor_session_hotspot
+};
+
+static bool cursor_session_supported(source_data* data) {
+    return data->copy_capture_manager && data->output_source_manager && data->pointer;
 }
 
-static void screencopy_frame_ready(void* _, struct zwlr_screencopy_frame_v1* frame, uint32_t tv_sec_hi, uint32_t tv_sec_lo, uint32_t tv_nsec) {
-    source_data* data = (source_data*) _;
-    data->screencopy_frame_failed = false;
+static void cursor_session_create(source_data* data, struct wl_output* output) {
+    // the image of the pointer is captured through its own session, which is only damaged when the image changes
+    capture_session* capture = &data->cursor_capture;
+    capture->source = ext_output_image_capture_source_manager_v1_create_source(data->output_source_manager, output);
+    data->cursor_session = ext_image_copy_capture_manager_v1_create_pointer_cursor_session(data->copy_capture_manager, capture->source, data->pointer);
+    ext_image_copy_capture_cursor_session_v1_add_listener(data->cursor_session, &cursor_session_listener, data);
+    capture->session = ext_image_copy_capture_cursor_session_v1_get_capture_session(data->cursor_session);
+    capture_session_listen(capture, &data->cursor_frame, output, false);
+    data->cursor_entered = false;
+    data->stats.requests++;
+    data->stats.objects++;
+}
+
+static void cursor_stop(source_data* data) {
+    // the pending copy and the session go before their buffers
+    if (data->cursor_frame.frame)
+        screencopy_state_end(&data->cursor_frame);
+    if (data->cursor_session) {
+        capture_session_destroy(&data->cursor_capture);
+        ext_image_copy_capture_cursor_session_v1_destroy(data->cursor_session);
+        data->cursor_session = NULL;
+        data->cursor_capture.target = NULL;
+        data->cursor_entered = false;
+        data->stats.requests++;
+    }
+    cursor_release(data);
+}
+
+static void cursor_point_upright(uint32_t transform, uint32_t buffer_width, uint32_t buffer_height, int32_t u, int32_t v, int32_t* x, int32_t* y) {
+    // map a point of the buffer to the upright frame, like source_draw_transformed undoes the transform
+    bool flipped = transform & WL_OUTPUT_TRANSFORM_FLIPPED;
+    uint32_t rotation = transform & WL_OUTPUT_TRANSFORM_270;
+    uint32_t undo = flipped ? (4 - rotation) & 3 : rotation;
+    if (flipped)
+        u = buffer_width - u;
+
+    switch (undo) {
+    case WL_OUTPUT_TRANSFORM_90:
+        *x = buffer_height - v;
+        *y = u;
+        break;
+    case WL_OUTPUT_TRANSFORM_180:
+        *x = buffer_width - u;
+        *y = buffer_height - v;
+        break;
+    case WL_OUTPUT_TRANSFORM_270:
+        *x = v;
+        *y = buffer_width - u;
+        break;
+    default:
+        *x = u;
+        *y = v;
+    }
+}
+
+static void cursor_session_publish(source_data* data) {
+    // position and hotspot are in buffer coordinates, the image is placed upright like the output frames
+    capture_target* target = &data->targets[0];
+    data->cursor_moved = false;
+    if (!data->cursor_entered || !data->cursor_image || target->buffer_width == 0) {
+        data->cursor_texture = NULL;
+        return;
+    }
+
+    int32_t u = data->cursor_position_x - data->cursor_hotspot_x, v = data->cursor_position_y - data->cursor_hotspot_y;
+    int32_t x1, y1, x2, y2;
+    cursor_point_upright(target->obs_transform, target->buffer_width, target->buffer_height, u, v, &x1, &y1);
+    cursor_point_upright(target->obs_transform, target->buffer_width, target->buffer_height, u + data->cursor_image_width, v + data->cursor_image_height, &x2, &y2);
+    data->cursor_x = x1 < x2 ? x1 : x2;
+    data->cursor_y = y1 < y2 ? y1 : y2;
+    data->cursor_texture = data->cursor_image;
+}
+
+// cursor regions
+
+static void cursor_request(source_data* data, uint64_t now) {
+    // cursor sessions follow the pointer themselves, copies complete once the image changes
+    capture_target* target = &data->targets[0];
+    if (cursor_session_supported(data) && target->output) {
+        if (data->cursor_session && (data->cursor_capture.stopped || data->cursor_capture.target != target->output))
+            cursor_stop(data);
+        if (!data->cursor_session)
+            cursor_session_create(data, target->output);
+        screencopy_state_begin_session(&data->cursor_frame, ext_image_copy_capture_session_v1_create_frame(data->cursor_capture.session));
+        return;
+    }
+
+    // otherwise the pointer position is in layout coordinates, the hyprland layout is cached and only needed without xdg-output
+    hyprland_monitor monitor;
+    if (target->info && target->info->logical_width > 0)
+        data->cursor_monitor = wl_output_info_layout(target->info);
+    else if (hyprland_get_monitor(data->capture_output_name, &monitor))
+        data->cursor_monitor = (output_layout) { monitor.x, monitor.y, monitor.scale };
+    else
+        data->cursor_monitor.scale = 0;
+
+    // find pointer on the captured output
+    double x, y;
+    double scale = data->cursor_monitor.scale;
+    if (scale <= 0 || target->buffer_width == 0 || !hyprland_get_cursor(&x, &y)) {
+        data->cursor_texture = NULL;
+        return;
+    }
+
+    // regions are requested in the upright logical space of the output
+    bool rotated = target->info && (target->info->transform & WL_OUTPUT_TRANSFORM_90);
+    x -= data->cursor_monitor.x;
+    y -= data->cursor_monitor.y;
+    double width = (rotated ? target->buffer_height : target->buffer_width) / scale;
+    double height = (rotated ? target->buffer_width : target->buffer_height) / scale;
+    if (x < 0 || y < 0 || x >= width || y >= height || width < CURSOR_REGION_SIZE || height < CURSOR_REGION_SIZE) {
+        data->cursor_texture = NULL;
+        return;
+    }
+
+    // a still pointer keeps its region
+    if (data->cursor_texture && x == data->cursor_pointer_x && y == data->cursor_pointer_y && now - data->cursor_copied_time < CURSOR_REFRESH_NS)
+        return;
+    data->cursor_pointer_x = x;
+    data->cursor_pointer_y = y;
+    data->cursor_copied_time = now;
+
+    // cursor images extend right and down from the hotspot
+    x -= CURSOR_REGION_SIZE / 4;
+    y -= CURSOR_REGION_SIZE / 4;
+    data->cursor_region_x = (int32_t) (x < 0 ? 0 : x > width - CURSOR_REGION_SIZE ? width - CURSOR_REGION_SIZE : x);
+    data->cursor_region_y = (int32_t) (y < 0 ? 0 : y > height - CURSOR_REGION_SIZE ? height - CURSOR_REGION_SIZE : y);
+    screencopy_state_begin(&data->cursor_frame, zwlr_screencopy_manager_v1_capture_output_region(data->screencopy_manager, 1, data->capture_output,
+        data->cursor_region_x, data->cursor_region_y, CURSOR_REGION_SIZE, CURSOR_REGION_SIZE));
+}
+
+static void cursor_copy(source_data* data) {
+    screencopy_state* cursor = &data->cursor_frame;
+    if (cursor->failed) {
+        screencopy_state_end(cursor);
+        data->cursor_texture = NULL;
+        return;
+    }
+
+    // recreate buffers on format change
+    capture_buffer* buffer = &data->cursor_buffers[data->cursor_buffer_index];
+    if (buffer->gbm_bo && (gbm_bo_get_width(buffer->gbm_bo) != cursor->width || gbm_bo_get_height(buffer->gbm_bo) != cursor->height || gbm_bo_get_format(buffer->gbm_bo) != cursor->format))
+        cursor_release(data);
+
+    if (!buffer->gbm_bo && !capture_buffer_create(data, buffer, cursor->width, cursor->height, cursor->format)) {
+        screencopy_state_end(cursor);
+        return;
+    }
+
+    // the pointer moves without damaging the output, and copies with damage would consume the damage of the output frames
+    screencopy_state_copy(cursor, buffer->wl_buffer, false);
+}
+
+static void cursor_finish(source_data* data) {
+    screencopy_state* cursor = &data->cursor_frame;
+    if (!cursor->failed && data->cursor_mode == CURSOR_SEPARATE && cursor->session) {
+        // the image follows the pointer without further copies
+        capture_buffer* buffer = &data->cursor_buffers[data->cursor_buffer_index];
+        data->cursor_swizzle = buffer->swizzle;
+        data->cursor_flip = 0;
+        data->cursor_transform = cursor->transform;
+        data->cursor_image = buffer->obs_texture;
+        data->cursor_image_width = cursor->width;
+        data->cursor_image_height = cursor->height;
+        data->cursor_buffer_index ^= 1;
+        cursor_session_publish(data);
+        trace_record(data->trace, TRACE_TRACK_CURSOR, TRACE_PUBLISH, cursor->presentation_time);
+    } else if (!cursor->failed && data->cursor_mode == CURSOR_SEPARATE) {
+        // the region is placed upright, its pixels are in buffer orientation like the output frames
+        capture_buffer* buffer = &data->cursor_buffers[data->cursor_buffer_index];
+        wl_output_info* info = data->targets[0].info;
+        data->cursor_x = (int32_t) (data->cursor_region_x * data->cursor_monitor.scale);
+        data->cursor_y = (int32_t) (data->cursor_region_y * data->cursor_monitor.scale);
+        data->cursor_swizzle = buffer->swizzle;
+        data->cursor_flip = (cursor->flags & ZWLR_SCREENCOPY_FRAME_V1_FLAGS_Y_INVERT) ? GS_FLIP_V : 0;
+        data->cursor_transform = info ? (uint32_t) info->transform : WL_OUTPUT_TRANSFORM_NORMAL;
+        data->cursor_texture = buffer->obs_texture;
+        data->cursor_buffer_index ^= 1;
+        trace_record(data->trace, TRACE_TRACK_CURSOR, TRACE_PUBLISH, cursor->presentation_time);
+    } else {
+        data->cursor_texture = NULL;
+    }
+
+    screencopy_state_end(cursor);
+}
+
+// capture pacing
+
+#define CAPTURE_BACKOFF_MAX_NS 2000000000ULL // slowest retry rate while captures fail
+#define CAPTURE_STATIC_THRESHOLD 30 // frames without damage before the rate is reduced
+#define CAPTURE_STATIC_MAX_SHIFT 3 // slowest poll rate on static content is 1/8 of the frame rate
+#define CAPTURE_THUMBNAIL_INTERVAL_NS 500000000ULL // 2 fps while the source is not in program
+#define CAPTURE_THUMBNAIL_SCALE 25 // percent of the captured size thumbnails are drawn from
+
+static bool capture_thumbnail(source_data* data) {
+    // only previews, projectors or the multiview show the source
+    return data->thumbnail_tier && !data->capture_live;
+}
+
+static uint64_t capture_interval(source_data* data) {
+    uint64_t duration = data->frame_duration_ns;
+    if (capture_thumbnail(data) && duration < CAPTURE_THUMBNAIL_INTERVAL_NS)
+        duration = CAPTURE_THUMBNAIL_INTERVAL_NS;
+
+    // exponential backoff on failures
+    if (data->capture_failures) {
+        uint32_t shift = data->capture_failures - 1;
+        if (shift > 20 || (duration << shift) > CAPTURE_BACKOFF_MAX_NS)
+            return duration > CAPTURE_BACKOFF_MAX_NS ? duration : CAPTURE_BACKOFF_MAX_NS; // never faster than the capture rate
+        return duration << shift;
+    }
+
+    // reduced polling on static content
+    if (data->capture_static_frames >= CAPTURE_STATIC_THRESHOLD) {
+        uint32_t shift = 1 + (data->capture_static_frames - CAPTURE_STATIC_THRESHOLD) / CAPTURE_STATIC_THRESHOLD;
+        return duration << (shift < CAPTURE_STATIC_MAX_SHIFT ? shift : CAPTURE_STATIC_MAX_SHIFT);
+    }
+
+    return duration;
+}
+
+// capability probe
+
+static void capture_probe_begin(source_data* data) {
+    data->probe_candidate = -1;
+    data->probe.best = -1;
+    data->probe_pending = data->buffer_type == BUFFER_AUTO;
+    if (!data->probe_pending)
+        return;
+
+    // the compositor renders on its main device, which decides how fast copies are
+    char driver[64];
+    device_driver(data->compositor_device ? data->compositor_device : device_number(data->gbm), driver, sizeof(driver));
+    probe_key(data->probe_key, sizeof(data->probe_key), &data->probe, driver);
+}
+
+// reuse the probe of the display or start it, while another source probes it the defaults are used and the claim is retried
+static void capture_probe_claim(source_data* data) {
+    if (!data->probe_pending || data->capture_type == CAPTURE_WINDOW || data->capture_type == CAPTURE_REPLAY)
+        return;
+
+    probe_result result = data->probe;
+    probe_claim_result claim = probe_claim(data->probe_key, &result);
+    if (claim == PROBE_CLAIM_BUSY)
+        return;
+
+    data->probe_pending = false;
+    if (claim == PROBE_CLAIM_CACHED) {
+        data->probe = result;
+        probe_log(obs_source_get_name(data->source), &data->probe, true);
+        return;
+    }
+
+    // nothing to choose from with a single candidate
+    probe_candidates_init(&data->probe, data->capture_sessions, data->screencopy_manager != NULL, data->linux_dmabuf != NULL, data->shm != NULL);
+    if (data->probe.candidate_count < 2) {
+        probe_release(data->probe_key, &data->probe);
+        return;
+    }
+    data->probe_candidate = 0;
+    blog(LOG_INFO, "[%s] Probing %u capture methods on %s", obs_source_get_name(data->source), data->probe.candidate_count, data->probe_key);
+}
+
+static void capture_probe_abandon(source_data* data) {
+    // another source, or this one once it captures outputs again, probes instead
+    if (data->probe_candidate < 0)
+        return;
+    probe_release(data->probe_key, NULL);
+    data->probe_candidate = -1;
+    data->probe_frames = 0;
+    data->probe_latency_ns = 0;
+    data->probe_start = 0;
+    data->probe_pending = true;
+}
+
+// candidate used for output captures, the measured one while probing, NULL for the defaults
+static const probe_candidate* capture_candidate(source_data* data) {
+    if (data->capture_type == CAPTURE_WINDOW || data->capture_type == CAPTURE_REPLAY)
+        return NULL;
+
+    int32_t index = data->probe_candidate >= 0 ? data->probe_candidate : data->buffer_type == BUFFER_AUTO ? data->probe.best : -1;
+    if (index < 0 || (data->probe.candidates[index].sessions && !data->capture_sessions))
+        return NULL;
+    return &data->probe.candidates[index];
+}
+
+static void capture_probe_next(source_data* data, bool works) {
+    probe_candidate* candidate = &data->probe.candidates[data->probe_candidate];
+    candidate->works = works && data->probe_frames > 0;
+    candidate->latency_ms = data->probe_frames ? data->probe_latency_ns / data->probe_frames / 1e6 : 0;
+    data->probe_frames = 0;
+    data->probe_latency_ns = 0;
+    data->probe_start = 0;
+    data->capture_failures = 0; // the next candidate starts without backoff
+    if (++data->probe_candidate < (int32_t) data->probe.candidate_count)
+        return;
+
+    // share the result with the other sources and the next launch, unless nothing worked
+    data->probe_candidate = -1;
+    const char* name = obs_source_get_name(data->source);
+    bool selected = probe_select(&data->probe);
+    probe_log(name, &data->probe, false);
+    probe_release(data->probe_key, &data->probe);
+    if (!selected)
+        blog(LOG_WARNING, "[%s] No capture method delivered frames while probing, using the defaults", name);
+}
+
+static void capture_probe_check(source_data* data, uint64_t now) {
+    // windows and replays are not probed
+    if (data->probe_candidate >= 0 && !capture_candidate(data))
+        capture_probe_abandon(data);
+
+    // judge candidates that deliver few or no frames after a while
+    if (data->probe_candidate < 0)
+        return;
+    if (data->probe_start == 0)
+        data->probe_start = now;
+    else if (now - data->probe_start >= PROBE_CANDIDATE_TIMEOUT_NS)
+        capture_probe_next(data, true);
+}
+
+static void capture_probe_frame(source_data* data, capture_target* target, uint64_t latency) {
+    const probe_candidate* candidate = capture_candidate(data);
+    if (data->probe_candidate < 0 || !candidate || target->buffer_shm != candidate->shm || target->frame.session != candidate->sessions)
+        return; // requested before the candidate changed
+
+    // record the offered formats along with the latency
+    if (candidate->shm) {
+        data->probe.shm_format = target->buffer_format;
+        data->probe.shm_offered = true;
+    } else {
+        data->probe.dmabuf_format = target->buffer_format;
+    }
+    data->probe_latency_ns += latency;
+    if (++data->probe_frames >= PROBE_FRAMES)
+        capture_probe_next(data, true);
+}
+
+static void capture_failed(source_data* data, const char* message) {
+    // a failing candidate is not used
+    if (data->probe_candidate >= 0 && capture_candidate(data))
+        capture_probe_next(data, false);
+
+    data->stats.failures++;
+    data->capture_failures++;
+    log_limited(&data->log_failures, obs_source_get_name(data->source), "%s, backing off", message);
+}
+
+static void capture_succeeded(source_data* data, bool damaged) {
+    if (data->capture_failures) {
+        log_limited(&data->log_recoveries, obs_source_get_name(data->source), "Capture recovered after %u failed frames", data->capture_failures);
+        data->capture_failures = 0;
+    }
+
+    // return to full rate on the first damage
+    data->capture_static_frames = damaged ? 0 : data->capture_static_frames + 1;
+}
+
+static void capture_wait(source_data* data, uint64_t start_time) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t end_time = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    uint64_t frame_time = end_time - start_time;
+    uint64_t interval = capture_interval(data);
+    if (frame_time < interval) {
+        uint64_t sleep_micros = (interval - frame_time) / 1000 * 0.9; // sleep 90% of the time to allow for some slack, if your display manages 900hz and you're capturing at 60hz.. screw you in particular
+
+        uint64_t wake_time = end_time + sleep_micros * 1000;
+
+        // low capture rates sleep in slices so the stop signal and going live are noticed
+        while (sleep_micros > 0 && !data->capture_stopsignal && !data->capture_wakeup) {
+            uint64_t slice = sleep_micros < 100000 ? sleep_micros : 100000;
+            data->stats.syscalls++;
+            usleep(slice);
+            sleep_micros -= slice;
+        }
+
+        // record how late the thread woke up
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        uint64_t now = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+        uint64_t latency = now > wake_time ? now - wake_time : 0;
+        data->stats.wakeups++;
+        data->stats.wakeup_latency_ns += latency;
+        if (latency > data->stats.wakeup_latency_max_ns)
+            data->stats.wakeup_latency_max_ns = latency;
+    }
+}
+
+static bool screencopy_frames_negotiated(source_data* data) {
+    // buffer parameters of all new frames are known, or they failed before
+    screencopy_state* cursor = &data->cursor_frame;
+    if (cursor->frame && !cursor->copied && !cursor->buffer_done && !cursor->failed)
+        return false;
+
+    for (uint32_t i = 0; i < data->target_count; i++) {
+        screencopy_state* frame = &data->targets[i].frame;
+        if (frame->frame && !frame->copied && !frame->buffer_done && !frame->failed)
+            return false;
+    }
+    return true;
+}
+
+static bool screencopy_frames_ready(source_data* data) {
+    // all pending output frames are ready, so the composited frame stays coherent, or the cursor moved
+    if ((data->cursor_frame.frame && data->cursor_frame.ready) || data->cursor_moved)
+        return true;
+
+    bool pending = false;
+    for (uint32_t i = 0; i < data->target_count; i++) {
+        screencopy_state* frame = &data->targets[i].frame;
+        if (frame->frame && !frame->ready)
+            return false;
+        pending |= frame->frame != NULL;
+    }
+
+    // frames ended while waiting, e.g. of a closed window, leave nothing to wait for unless the cursor is pending
+    return pending || !data->cursor_frame.frame;
+}
+
+static void screencopy_dispatch(source_data* data, uint64_t deadline, bool (*done)(source_data*)) {
+    // dispatch events until the condition holds, polling so the stop signal is noticed
+    struct timespec ts;
+    while (!done(data)) {
+        if (data->capture_stopsignal)
+            return;
+
+        int timeout = 100;
+        if (deadline) {
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            uint64_t now = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+            if (now >= deadline)
+                return;
+            if ((deadline - now) / 1000000 < (uint64_t) timeout)
+                timeout = (deadline - now) / 1000000 + 1;
+        }
+
+        while (wl_display_prepare_read(data->wl) != 0)
+            wl_display_dispatch_pending(data->wl);
+        wl_display_flush(data->wl);
+
+        struct pollfd pfd = { .fd = wl_display_get_fd(data->wl), .events = POLLIN };
+        data->stats.syscalls += 2;
+        if (poll(&pfd, 1, timeout) <= 0) {
+            wl_display_cancel_read(data->wl);
+            continue;
+        }
+
+        data->stats.syscalls++;
+        if (wl_display_read_events(data->wl) == -1 || wl_display_dispatch_pending(data->wl) == -1) {
+            blog(LOG_ERROR, "Lost connection to Wayland display");
+            data->capture_stopsignal = true;
+            return;
+        }
+    }
+}
+
+// capture targets
+
+static void capture_target_release(source_data* data, capture_target* target) {
+    if (target->frame.frame)
+        screencopy_state_end(&target->frame);
+    if (target->session.session)
+        capture_session_destroy(&target->session);
+    capture_buffers_release(data, target, target->buffer_count);
+}
+
+static void capture_replay_close(source_data* data) {
+    if (data->replay)
+        record_reader_close(data->replay);
+    bfree(data->replay_image);
+    data->replay = NULL;
+    data->replay_image = NULL;
+}
+
+static void capture_replay_open(source_data* data) {
+    // the recording takes the place of the compositor on the first target
+    capture_replay_close(data);
+    capture_target_release(data, &data->targets[0]);
+    if (!data->replay_path || strlen(data->replay_path) == 0)
+        return;
+
+    data->replay = record_reader_open(data->replay_path);
+    if (!data->replay)
+        return;
+
+    const record_header* header = record_reader_header(data->replay);
+    data->replay_image = bzalloc((size_t) header->width * header->height * header->bytes_per_pixel);
+    data->replay_index = 0;
+    data->replay_start = 0;
+}
+
+// frame duration of the fastest captured output, requires capture_outputs_mutex
+static uint64_t capture_outputs_frame_duration(source_data* data) {
+    int32_t refresh = 0;
+    for (uint32_t i = 0; i < data->capture_output_count; i++)
+        refresh = data->capture_outputs[i]->refresh > refresh ? data->capture_outputs[i]->refresh : refresh;
+    return refresh > 0 ? 1000000000000ULL / refresh : obs_get_frame_interval_ns();
+}
+
+static void capture_targets_apply(source_data* data) {
+    // output selection and layout changes are applied on the capture thread, which owns the buffers
+    pthread_mutex_lock(&data->capture_outputs_mutex);
+    uint32_t count = data->capture_output_count;
+    bool moved = false;
+    for (uint32_t i = 0; i < count; i++)
+        moved |= data->capture_outputs[i]->layout_changed;
+    if (!data->capture_outputs_changed && !moved) {
+        pthread_mutex_unlock(&data->capture_outputs_mutex);
+        return;
+    }
+    data->capture_outputs_changed = false;
+
+    // wlroots based compositors report every output at 0,0 through wl_output, prefer the xdg-output layout
+    output_layout layout[MAX_CAPTURE_TARGETS];
+    bool overlapping = count > 1;
+    for (uint32_t i = 0; i < count; i++) {
+        wl_output_info* info = data->capture_outputs[i];
+        info->layout_changed = false;
+        layout[i] = wl_output_info_layout(info);
+        overlapping &= layout[i].x == layout[0].x && layout[i].y == layout[0].y;
+    }
+
+    // place outputs relative to the top left output of the layout
+    double min_x = INFINITY, min_y = INFINITY;
+    data->target_scale = 1;
+    data->target_row = overlapping;
+    for (uint32_t i = 0; i < count; i++) {
+        min_x = layout[i].x < min_x ? layout[i].x : min_x;
+        min_y = layout[i].y < min_y ? layout[i].y : min_y;
+        data->target_scale = layout[i].scale > data->target_scale ? layout[i].scale : data->target_scale;
+    }
+
+    for (uint32_t i = 0; i < MAX_CAPTURE_TARGETS; i++) {
+        capture_target* target = &data->targets[i];
+        wl_output_info* info = i < count ? data->capture_outputs[i] : NULL;
+        if (target->output != (info ? info->output : NULL) || (i >= count && i > 0))
+            capture_target_release(data, target);
+
+        target->output = info ? info->output : NULL;
+        target->info = info;
+        target->scale = info ? layout[i].scale : 1;
+        target->x = info ? (int32_t) round((layout[i].x - min_x) * data->target_scale) : 0;
+        target->y = info ? (int32_t) round((layout[i].y - min_y) * data->target_scale) : 0;
+    }
+
+    // windows and replays are captured through the first target without an output
+    if (data->capture_type == CAPTURE_REPLAY)
+        capture_replay_open(data);
+    else if (data->replay)
+        capture_replay_close(data);
+    data->target_count = data->capture_type == CAPTURE_WINDOW || data->capture_type == CAPTURE_REPLAY ? 1 : count;
+
+    // the output rate follows mode changes
+    if (data->capture_rate == RATE_OUTPUT)
+        data->frame_duration_ns = capture_outputs_frame_duration(data);
+    pthread_mutex_unlock(&data->capture_outputs_mutex);
+}
+
+static void capture_targets_extent(source_data* data) {
+    uint32_t width = 0, height = 0;
+    for (uint32_t i = 0; i < data->target_count; i++) {
+        // rotated outputs are laid out upright
+        capture_target* target = &data->targets[i];
+        bool rotated = target->obs_transform & WL_OUTPUT_TRANSFORM_90;
+        target->width = (uint32_t) round((rotated ? target->buffer_height : target->buffer_width) * data->target_scale / target->scale);
+        target->height = (uint32_t) round((rotated ? target->buffer_width : target->buffer_height) * data->target_scale / target->scale);
+        if (data->target_row) {
+            target->x = width;
+            target->y = 0;
+        }
+        width = target->x + target->width > width ? target->x + target->width : width;
+        height = target->y + target->height > height ? target->y + target->height : height;
+    }
+    data->width = width;
+    data->height = height;
+}
+
+// capture thread
+
+static void capture_output_request(source_data* data, capture_target* target) {
+    // sessions capture one output or window with fixed cursor options, restart them on change
+    capture_session* session = &target->session;
+    capture_type type = data->capture_type;
+    void* source = type == CAPTURE_WINDOW ? (void*) data->capture_toplevel : (void*) target->output;
+    bool paint_cursors = data->cursor_mode == CURSOR_EMBEDDED;
+    if (session->session && (session->stopped || session->target != source || session->paint_cursors != paint_cursors))
+        capture_session_destroy(session);
+
+    // only the first frame of a session is copied without waiting for damage, the probe measures whole frames
+    if (session->session && data->probe_candidate >= 0)
+        capture_session_destroy(session);
+
+    if (!session->session)
+        capture_session_create(data, session, &target->frame, type, source, paint_cursors);
+
+    screencopy_state_begin_session(&target->frame, ext_image_copy_capture_session_v1_create_frame(session->session));
+}
+
+static bool capture_output_copy(source_data* data, capture_target* target) {
+    screencopy_state* output = &target->frame;
+    if (output->failed) {
+        capture_failed(data, "Failed to capture output");
+        screencopy_state_end(output);
+        return false;
+    }
+
+    // fall back to shared memory without dma-buf support, uploads are limited to the damage
+    const probe_candidate* candidate = capture_candidate(data);
+    bool shm = candidate ? candidate->shm : data->buffer_type == BUFFER_SHM || (data->buffer_type == BUFFER_AUTO && (output->format == 0 || !data->linux_dmabuf));
+    if (shm ? !output->shm_offered || !data->shm : output->format == 0) {
+        capture_failed(data, shm ? "Compositor offered no shared memory format" : "Compositor offered no DMA-BUF format");
+        screencopy_state_end(output);
+        return false;
+    }
+
+    // recreate buffers on format change
+    uint32_t format = shm ? shm_format_to_drm(output->shm_format) : output->format;
+    if (target->buffer_count && (target->buffer_width != output->width || target->buffer_height != output->height || target->buffer_format != format || target->buffer_shm != shm))
+        capture_buffers_release(data, target, target->buffer_count);
+
+    // shrink buffer ring while all sources exceed the vram budget, or another source got no buffer at all
+    if (data->vram_budget && (vram_usage_total > data->vram_budget || (vram_starved_sources && !data->vram_starved)) && target->buffer_count > 1) {
+        capture_buffers_release(data, target, 1);
+        log_limited(&data->log_buffers, obs_source_get_name(data->source), "VRAM budget exceeded, reduced capture buffers to %u (all sources: %.1f MiB)",
+            target->buffer_count, vram_usage_total / 1048576.0);
+    }
+
+    if (target->buffer_count == 0) {
+        capture_buffers_allocate(data, target, shm);
+        if (target->buffer_count == 0) {
+            data->capture_failures++;
+            data->stats.failures++;
+            screencopy_state_end(output);
+            return false;
+        }
+    }
+
+    // copy frame to dma-buf or shared memory, the probe measures copies of whole frames instead of the wait for damage
+    screencopy_state_copy(output, target->buffers[target->buffer_index].wl_buffer, data->probe_candidate < 0);
+    return true;
+}
+
+static void capture_output_publish(source_data* data, capture_target* target, uint64_t start_time, bool* damaged) {
+    // publish frame and advance ring, also while probing so the source shows frames from the start
+    screencopy_state* output = &target->frame;
+    capture_buffer* buffer = &target->buffers[target->buffer_index];
+    target->obs_swizzle = buffer->swizzle;
+    target->obs_color_space = buffer->color_space;
+    target->obs_flip = (output->flags & ZWLR_SCREENCOPY_FRAME_V1_FLAGS_Y_INVERT) ? GS_FLIP_V : 0;
+    target->obs_transform = output->session ? output->transform : target->info ? (uint32_t) target->info->transform : WL_OUTPUT_TRANSFORM_NORMAL; // screencopy frames follow the output
+    target->obs_texture = target->buffer_shm && !target->shm_imported ? target->upload.texture : target->local_texture ? target->local_texture : buffer->obs_texture;
+    target->obs_frame++;
+    data->obs_linear = buffer->linear;
+    if (target == &data->targets[0])
+        data->obs_color_space = target->obs_color_space; // the source follows its main target, never the cursor buffers
+    target->buffer_index = (target->buffer_index + 1) % target->buffer_count;
+    *damaged |= (!output->with_damage && !output->unchanged) || output->damaged;
+    trace_record(data->trace, output->trace_track, TRACE_PUBLISH, output->presentation_time);
+
+    // waiting for damage is not a slow capture
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t now = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    uint64_t frame_time = now - start_time;
+
+    // measure from presentation if the compositor timestamp is on our clock
+    uint64_t presented = output->presentation_time;
+    bool monotonic = presented && presented >= start_time - CAPTURE_BACKOFF_MAX_NS && presented <= now;
+    latency_histogram_add(&data->stats.latency, now - (monotonic ? presented : start_time));
+    capture_probe_frame(data, target, now - start_time); // probed frames are copied right away, the request is the fair start for all candidates
+    if (!output->with_damage && frame_time >= data->frame_duration_ns)
+        log_limited(&data->log_slow_frames, obs_source_get_name(data->source), "Frame took too long to capture: %.2f ms", frame_time / 1e6);
+}
+
+static void capture_record_stop(source_data* data) {
+    if (data->recorder)
+        record_writer_close(data->recorder);
+    data->recorder = NULL;
+    bfree(data->record_path);
+    data->record_path = NULL;
+}
+
+static void capture_record(source_data* data, capture_target* target) {
+    // the recording follows a single output or window, composited frames are not recorded
+    screencopy_state* output = &target->frame;
+    capture_buffer* buffer = &target->buffers[target->buffer_index];
+    if (!data->record_path || data->target_count != 1 || (!buffer->gbm_bo && !buffer->shm_data))
+        return;
+
+    // the format of the buffer that was copied into, shared memory formats differ from the offered dma-buf format
+    uint32_t format = target->buffer_format;
+    if (!data->recorder) {
+        uint32_t bpp = format_bytes_per_pixel(format);
+        data->recorder = bpp ? record_writer_open(data->record_path, output->width, output->height, format, bpp) : NULL;
+        if (!data->recorder) {
+            blog(LOG_ERROR, "Recording stopped, unable to record format %.4s", (const char*) &format);
+            capture_record_stop(data);
+            return;
+        }
+    } else if (!record_writer_matches(data->recorder, output->width, output->height, format)) {
+        blog(LOG_WARNING, "Recording stopped, the captured frame size or format changed");
+        capture_record_stop(data);
+        return;
+    }
+
+    // without damage reports every frame is recorded completely
+    damage_region damage = output->damage;
+    if (!output->with_damage)
+        damage_region_full(&damage, output->width, output->height);
+
+    // read back through a mapping of the dma-buf, recording is not meant to be cheap
+    uint32_t stride = buffer->shm_stride;
+    void* map_data = NULL;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint8_t* pixels = buffer->shm_data;
+    if (buffer->gbm_bo)
+        pixels = gbm_bo_map(buffer->gbm_bo, 0, 0, output->width, output->height, GBM_BO_TRANSFER_READ, &stride, &map_data);
+    if (!pixels) {
+        blog(LOG_ERROR, "Recording stopped, failed to map the capture buffer");
+        capture_record_stop(data);
+        return;
+    }
+
+    bool written = record_writer_add(data->recorder, ts.tv_sec * 1000000000ULL + ts.tv_nsec, output->presentation_time,
+        output->flags, &damage, pixels, stride);
+    if (buffer->gbm_bo)
+        gbm_bo_unmap(buffer->gbm_bo, map_data);
+    if (!written)
+        capture_record_stop(data);
+}
+
+static void capture_output_upload(source_data* data, capture_target* target) {
+    // only damaged tiles are transferred into the persistent texture, without damage they are found by comparing frames
+    screencopy_state* output = &target->frame;
+    capture_buffer* buffer = &target->buffers[target->buffer_index];
+    if (output->with_damage)
+        upload_texture_mark_damage(&target->upload, &output->damage);
+    else
+        upload_texture_mark_changed(&target->upload, buffer->shm_data, buffer->shm_stride, &output->unchanged);
+
+    // the graphics context is only held for the transfer itself
+    obs_enter_graphics();
+    data->stats.uploaded_bytes += upload_texture_flush(&target->upload, buffer->shm_data, buffer->shm_stride);
+    obs_leave_graphics();
+    data->stats.unchanged_frames += output->unchanged;
+}
+
+static void capture_output_cross_copy(source_data* data, capture_target* target) {
+    // one copy into local memory per frame, renders then never sample the other gpu
+    capture_buffer* buffer = &target->buffers[target->buffer_index];
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t start = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+
+    // the copy counts against the budget, without room the frames are sampled on the other gpu
+    obs_enter_graphics();
+    enum gs_color_format format = gs_texture_get_color_format(buffer->obs_texture);
+    uint64_t size = (uint64_t) target->buffer_width * target->buffer_height * (gs_get_format_bpp(format) / 8);
+    if (!target->local_texture && capture_buffer_reserve(data, size)) {
+        target->local_texture = gs_texture_create(target->buffer_width, target->buffer_height, format, 1, NULL, 0);
+        if (target->local_texture)
+            target->local_size = size;
+        else
+            capture_buffer_unreserve(data, size);
+    }
+    if (target->local_texture)
+        gs_copy_texture(target->local_texture, buffer->obs_texture);
+    obs_leave_graphics();
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    data->stats.cross_copies++;
+    data->stats.cross_copy_ns += ts.tv_sec * 1000000000ULL + ts.tv_nsec - start;
+}
+
+static bool capture_output_finish(source_data* data, capture_target* target, uint64_t start_time, bool* damaged) {
+    screencopy_state* output = &target->frame;
+    if (output->failed) {
+        if (!data->capture_stopsignal)
+            capture_failed(data, target->buffer_shm ? "Failed to copy frame to shared memory" : "Failed to copy frame to DMA-BUF");
+        screencopy_state_end(output);
+        return false;
+    }
+
+    capture_record(data, target);
+    if (target->buffer_shm && !target->shm_imported)
+        capture_output_upload(data, target);
+    else if (data->cross_gpu && target->buffers[target->buffer_index].obs_texture)
+        capture_output_cross_copy(data, target);
+    capture_output_publish(data, target, start_time, damaged);
+    screencopy_state_end(output);
+    return true;
+}
+
+static void source_log_flush(source_data* data) {
+    const char* name = obs_source_get_name(data->source);
+    log_limited_flush(&data->log_failures, name);
+    log_limited_flush(&data->log_recoveries, name);
+    log_limited_flush(&data->log_buffers, name);
+    log_limited_flush(&data->log_slow_frames, name);
+}
+
+static void source_stats_published(source_data* data) {
+    // the previous frame was replaced without being drawn
+    if (data->stats.frames && data->rendered_frame != data->stats.frames)
+        data->stats.drops++;
+    data->stats.frames++;
+
+    // update the frame rate once per second
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t now = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    data->stats.fps_window_frames++;
+    if (now - data->stats.fps_window_start >= 1000000000ULL) {
+        data->stats.fps = data->stats.fps_window_start ? data->stats.fps_window_frames * 1e9 / (now - data->stats.fps_window_start) : 0;
+        data->stats.fps_window_start = now;
+        data->stats.fps_window_frames = 0;
+    }
+}
+
+static bool capture_replay_buffers_allocate(source_data* data, capture_target* target) {
+    // frames are uploaded into textures instead of copied into dma-bufs
+    const record_header* header = record_reader_header(data->replay);
+    const format_info* info = format_lookup(header->format);
+    bool swizzle;
+    if (!info || !format_upload_supported(header->format, &swizzle) || format_bytes_per_pixel(header->format) != header->bytes_per_pixel) {
+        capture_failed(data, "Unable to replay frames of this format");
+        return false;
+    }
+
+    obs_enter_graphics();
+    while (target->buffer_count < data->buffer_count_requested) {
+        capture_buffer* buffer = &target->buffers[target->buffer_count];
+        uint64_t size = (uint64_t) header->width * header->height * header->bytes_per_pixel;
+        if (!capture_buffer_reserve(data, size))
+            break;
+        buffer->obs_texture = gs_texture_create(header->width, header->height, info->color_format, 1, NULL, GS_DYNAMIC);
+        if (!buffer->obs_texture) {
+            capture_buffer_unreserve(data, size);
+            break;
+        }
+
+        buffer->swizzle = swizzle;
+        buffer->linear = info->linear;
+        buffer->color_space = info->color_space;
+        buffer->size = size;
+        data->stats.allocations++;
+        target->buffer_count++;
+    }
+    obs_leave_graphics();
+    capture_buffers_starved(data, target->buffer_count == 0 && data->vram_budget);
+
+    target->buffer_width = header->width;
+    target->buffer_height = header->height;
+    target->buffer_format = header->format;
+    return target->buffer_count > 0;
+}
+
+static void capture_replay_frame(source_data* data, uint64_t start_time) {
+    capture_target* target = &data->targets[0];
+    screencopy_state* output = &target->frame;
+    if (!data->replay || record_reader_header(data->replay)->frame_count == 0)
+        return;
+
+    if (target->buffer_count == 0 && !capture_replay_buffers_allocate(data, target))
+        return;
+
+    // start over at the end of the recording, the first frame is complete
+    const record_header* header = record_reader_header(data->replay);
+    if (data->replay_index >= header->frame_count) {
+        data->replay_index = 0;
+        data->replay_start = 0;
+    }
+    if (data->replay_start == 0)
+        data->replay_start = start_time;
+
+    // like a copy with damage, the frame is held until the recording has the next frame
+    trace_record(output->trace, output->trace_track, TRACE_REQUEST, 0);
+    uint64_t due = data->replay_start + record_reader_frame(data->replay, data->replay_index)->time;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t now = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    while (now < due && !data->capture_stopsignal) {
+        uint64_t slice = (due - now) / 1000 < 100000 ? (due - now) / 1000 + 1 : 100000;
+        data->stats.syscalls++;
+        usleep(slice);
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        now = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    }
+    if (data->capture_stopsignal)
+        return;
+
+    // deliver every frame that is due, accumulating their damage like the compositor would
+    screencopy_state_reset(output);
+    const record_frame* frame = NULL;
+    uint32_t stride = header->width * header->bytes_per_pixel;
+    while (data->replay_index < header->frame_count) {
+        const record_frame* next = record_reader_frame(data->replay, data->replay_index);
+        if (frame && data->replay_start + next->time > now)
+            break;
+        record_reader_apply(data->replay, next, data->replay_image, stride, &output->damage);
+        frame = next;
+        data->replay_index++;
+    }
+
+    capture_buffer* buffer = &target->buffers[target->buffer_index];
+    obs_enter_graphics();
+    gs_texture_set_image(buffer->obs_texture, data->replay_image, stride, false);
+    obs_leave_graphics();
+
+    output->flags = frame->flags;
+    output->with_damage = true;
+    output->damaged = output->damage.count > 0;
+    output->presentation_time = frame->presentation_age ? data->replay_start + frame->time - frame->presentation_age : 0;
+    trace_record(output->trace, output->trace_track, TRACE_READY, output->presentation_time);
+
+    bool damaged = false;
+    capture_output_publish(data, target, start_time, &damaged);
+    source_stats_published(data);
+    capture_targets_extent(data);
+    capture_succeeded(data, damaged);
 }
 
-static void screencopy_frame_failed(void* _, struct zwlr_screencopy_frame_v1* frame) {
-    source_data* data = (source_data*) _;
-    data->screencopy_frame_failed = true;
+static void capture_roundtrip_done(void* _, struct wl_callback* callback, uint32_t time) {
+    ((source_data*) _)->connect_synced = true;
 }
 
-static struct zwlr_screencopy_frame_v1_listener screencopy_frame_listener = {
-    .buffer = noop,
-    .flags = noop,
-    .ready = screencopy_frame_ready,
-    .failed = screencopy_frame_failed,
-    .damage = noop,
-    .linux_dmabuf = screencopy_frame_linux_dmabuf,
-    .buffer_done = noop
+static const struct wl_callback_listener capture_roundtrip_listener = {
+    .done = capture_roundtrip_done
 };
 
-// capture thread
+static bool capture_roundtrip_finished(source_data* data) {
+    return data->connect_synced;
+}
+
+static bool capture_roundtrip(source_data* data, uint64_t deadline) {
+    // like wl_display_roundtrip, but gives up at the deadline or on the stop signal
+    data->connect_synced = false;
+    struct wl_callback* callback = wl_display_sync(data->wl);
+    wl_callback_add_listener(callback, &capture_roundtrip_listener, data);
+    screencopy_dispatch(data, deadline, capture_roundtrip_finished);
+    wl_callback_destroy(callback);
+    return data->connect_synced;
+}
 
+static bool capture_target_found(source_data* data) {
+    return data->capture_wakeup || data->capture_outputs_changed || (data->capture_type == CAPTURE_WINDOW && data->capture_toplevel);
+}
+
+static bool capture_connect(source_data* data);
+static void capture_disconnect(source_data* data);
 static void* capture_thread(void* _) {
     source_data* data = (source_data*) _;
+    screencopy_state* cursor = &data->cursor_frame;
+    thread_apply_options(&data->capture_thread_options);
+
+    // retry failed connections with the backoff of failed captures, the compositor may start after obs
+    struct timespec ts;
+    while (!capture_connect(data)) {
+        capture_disconnect(data);
+        if (data->capture_stopsignal)
+            return NULL;
 
-    // buffer objects
-    struct gbm_bo* gbm_bo = NULL;
-    struct wl_buffer* wl_buffer = NULL;
-    uint32_t gbm_bo_width = 0;
-    uint32_t gbm_bo_height = 0;
-    uint32_t gbm_bo_format = 0;
+        data->capture_failures++;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        capture_wait(data, ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+    }
+    if (data->capture_failures)
+        log_limited(&data->log_recoveries, obs_source_get_name(data->source), "Connected after %u failed attempts", data->capture_failures);
+    data->capture_failures = 0;
 
     // loop capture
-    struct timespec ts;
     while (!data->capture_stopsignal) {
-        if (!data->capture_output) {
-            usleep(1000); // 1ms
+        source_log_flush(data); // summarize suppressed messages
+        data->capture_wakeup = false;
+        capture_targets_apply(data);
+        if (data->target_count == 0 || (data->capture_type == CAPTURE_WINDOW && !data->capture_toplevel)) {
+            // windows are only announced through dispatched events, sleep in the poll until one appears or the settings change
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            screencopy_dispatch(data, ts.tv_sec * 1000000000ULL + ts.tv_nsec + capture_interval(data), capture_target_found);
             continue;
         }
 
@@ -107,152 +1975,317 @@ static void* capture_thread(void* _) {
         clock_gettime(CLOCK_MONOTONIC, &ts);
         uint64_t start_time = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
 
-        // request output capture
-        struct zwlr_screencopy_frame_v1* screencopy_frame = zwlr_screencopy_manager_v1_capture_output(data->screencopy_manager, 0, data->capture_output);
-        zwlr_screencopy_frame_v1_add_listener(screencopy_frame, &screencopy_frame_listener, data);
-        wl_display_roundtrip(data->wl);
-        if (data->screencopy_frame_failed) {
-            blog(LOG_ERROR, "Failed to capture output");
+        // replays go through the same pacing and publishing without the compositor
+        if (data->capture_type == CAPTURE_REPLAY) {
+            capture_replay_frame(data, start_time);
+            capture_wait(data, start_time);
             continue;
         }
 
-        // create dma-buf
-        if ((gbm_bo_width != data->screencopy_frame_width || gbm_bo_height != data->screencopy_frame_height || gbm_bo_format != data->screencopy_frame_format) && gbm_bo) {
-            gbm_bo_destroy(gbm_bo);
-            wl_buffer_destroy(wl_buffer);
+        // the first source of a display probes it, the others capture with the defaults until the result is known
+        capture_probe_claim(data);
+
+        // request captures of all targets at once unless the previous copy is still waiting for damage
+        capture_probe_check(data, start_time);
+        const probe_candidate* candidate = capture_candidate(data);
+        bool sessions = candidate ? candidate->sessions : data->capture_sessions;
+        for (uint32_t i = 0; i < data->target_count; i++) {
+            capture_target* target = &data->targets[i];
+            if (!sessions && target->session.session && !target->frame.frame)
+                capture_session_destroy(&target->session); // the probe moved to wlr-screencopy
+            if (!target->frame.frame && sessions)
+                capture_output_request(data, target);
+            else if (!target->frame.frame)
+                screencopy_state_begin(&target->frame, zwlr_screencopy_manager_v1_capture_output(data->screencopy_manager, data->cursor_mode == CURSOR_EMBEDDED, target->output));
+        }
 
-            obs_enter_graphics();
-            gs_texture_destroy(data->obs_texture);
-            obs_leave_graphics();
+        // request the cursor image, or a region around the pointer
+        if (data->cursor_mode == CURSOR_SEPARATE && !cursor->frame)
+            cursor_request(data, start_time);
+        else if (data->cursor_mode != CURSOR_SEPARATE && (cursor->frame || data->cursor_session || data->cursor_buffers[0].gbm_bo))
+            cursor_stop(data);
 
-            data->obs_texture = NULL;
-            gbm_bo = NULL;
-            wl_buffer = NULL;
-        }
+        // receive buffer parameters of new frames, without the sync object of a roundtrip
+        screencopy_dispatch(data, 0, screencopy_frames_negotiated);
+        if (data->capture_stopsignal)
+            break;
 
-        if (!gbm_bo) {
-            gbm_bo_width = data->screencopy_frame_width;
-            gbm_bo_height = data->screencopy_frame_height;
-            gbm_bo_format = data->screencopy_frame_format;
-            gbm_bo = gbm_bo_create(data->gbm, gbm_bo_width, gbm_bo_height, gbm_bo_format, GBM_BO_USE_RENDERING);
-            if (gbm_bo == NULL) {
-                blog(LOG_ERROR, "Failed to create GBM buffer object");
-                continue;
-            }
-
-            int32_t fd = gbm_bo_get_fd_for_plane(gbm_bo, 0);
-            uint32_t offset = gbm_bo_get_offset(gbm_bo, 0);
-            uint32_t stride = gbm_bo_get_stride_for_plane(gbm_bo, 0);
-            uint64_t modifier = gbm_bo_get_modifier(gbm_bo);
-
-            // create wl_buffer
-            struct zwp_linux_buffer_params_v1* params = zwp_linux_dmabuf_v1_create_params(data->linux_dmabuf);
-            zwp_linux_buffer_params_v1_add(params,
-                fd,
-                0,
-                offset,
-                stride,
-                modifier >> 32,
-                modifier & 0xFFFFFFFF
-            );
-            wl_buffer = zwp_linux_buffer_params_v1_create_immed(params, gbm_bo_width, gbm_bo_height, data->screencopy_frame_format, 0);
-            zwp_linux_buffer_params_v1_destroy(params);
-
-            // find fitting color format
-            enum gs_color_format color_format = GS_BGRX;
-            data->obs_color_space = GS_CS_SRGB;
-            if (data->screencopy_frame_format == GBM_FORMAT_XRGB2101010
-                || data->screencopy_frame_format == GBM_FORMAT_XBGR2101010
-                || data->screencopy_frame_format == GBM_FORMAT_RGBX1010102
-                || data->screencopy_frame_format == GBM_FORMAT_BGRX1010102
-
-                || data->screencopy_frame_format == GBM_FORMAT_ARGB2101010
-                || data->screencopy_frame_format == GBM_FORMAT_ABGR2101010
-                || data->screencopy_frame_format == GBM_FORMAT_RGBA1010102
-                || data->screencopy_frame_format == GBM_FORMAT_BGRA1010102) {
-                color_format = GS_R10G10B10A2;
-                data->obs_color_space = GS_CS_SRGB_16F;
-            } else if (data->screencopy_frame_format == GBM_FORMAT_XBGR16161616
-                || data->screencopy_frame_format == GBM_FORMAT_ABGR16161616) {
-                color_format = GS_RGBA16;
-                data->obs_color_space = GS_CS_SRGB_16F;
-            }
-
-            // create obs texture
-            obs_enter_graphics();
-            data->obs_texture = gs_texture_create_from_dmabuf(
-                gbm_bo_width,
-                gbm_bo_height,
-                gbm_bo_format,
-                color_format,
-                1,
-                &fd,
-                &stride,
-                &offset,
-                &modifier
-            );
-            obs_leave_graphics();
+        bool copied = false;
+        for (uint32_t i = 0; i < data->target_count; i++) {
+            capture_target* target = &data->targets[i];
+            if (target->frame.frame && !target->frame.copied)
+                capture_output_copy(data, target);
+            copied |= target->frame.frame != NULL;
         }
-
-        // copy frame to dma-buf
-        zwlr_screencopy_frame_v1_copy(screencopy_frame, wl_buffer);
-        wl_display_roundtrip(data->wl);
-        if (data->screencopy_frame_failed) {
-            blog(LOG_ERROR, "Failed to copy frame to DMA-BUF");
-            zwlr_screencopy_frame_v1_destroy(screencopy_frame);
+        if (!copied) {
+            capture_wait(data, start_time);
             continue;
         }
 
-        // release frame
-        zwlr_screencopy_frame_v1_destroy(screencopy_frame);
+        if (cursor->frame && !cursor->copied)
+            cursor_copy(data);
 
-        // wait for next frame
-        clock_gettime(CLOCK_MONOTONIC, &ts);
-        uint64_t end_time = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
-        uint64_t frame_time = end_time - start_time;
-        if (frame_time < data->frame_duration_ns) {
-            uint64_t sleep_micros = (data->frame_duration_ns - frame_time) / 1000;
-            usleep(sleep_micros * 0.9); // sleep 90% of the time to allow for some slack, if your display manages 900hz and you're capturing at 60hz.. screw you in particular
-        } else {
-            blog(LOG_WARNING, "Frame took too long to capture: %lu ns", frame_time);
+        // wait for the output frames, the cursor and other outputs keep updating while one output is static
+        bool deadline = data->cursor_mode == CURSOR_SEPARATE || data->target_count > 1;
+        screencopy_dispatch(data, deadline ? start_time + capture_interval(data) : 0, screencopy_frames_ready);
+        if (data->capture_stopsignal)
+            break;
+
+        bool published = false, damaged = false;
+        for (uint32_t i = 0; i < data->target_count; i++) {
+            capture_target* target = &data->targets[i];
+            if (target->frame.frame && target->frame.ready)
+                published |= capture_output_finish(data, target, start_time, &damaged);
+        }
+        if (published) {
+            source_stats_published(data);
+            capture_targets_extent(data);
+            capture_succeeded(data, damaged);
         }
+        if (cursor->frame && cursor->ready)
+            cursor_finish(data);
+        else if (data->cursor_moved && data->cursor_session)
+            cursor_session_publish(data);
+
+        // wait for next frame
+        capture_wait(data, start_time);
     }
 
-    // destroy dma-buf
-    if (gbm_bo != NULL) {
-        gbm_bo_destroy(gbm_bo);
-        wl_buffer_destroy(wl_buffer);
+    // let another source finish an interrupted probe
+    capture_probe_abandon(data);
 
-        obs_enter_graphics();
-        gs_texture_destroy(data->obs_texture);
-        data->obs_texture = NULL;
-        obs_leave_graphics();
-    }
+    // release pending frames and destroy dma-bufs
+    for (uint32_t i = 0; i < MAX_CAPTURE_TARGETS; i++)
+        capture_target_release(data, &data->targets[i]);
+    cursor_stop(data);
+    capture_buffers_starved(data, false);
+    capture_record_stop(data);
+    capture_replay_close(data);
 
     return NULL;
 }
 
 // wayland output
 
+static void wl_output_info_set(wl_output_info* info, char** field, const char* value) {
+    // properties read the strings from the ui thread
+    source_data* data = info->source;
+    pthread_mutex_lock(&data->outputs_mutex);
+    free(*field);
+    *field = strdup(value);
+    pthread_mutex_unlock(&data->outputs_mutex);
+}
+
 static void wl_output_name(void* _, struct wl_output* output, const char* name) {
     wl_output_info* info = (wl_output_info*) _;
-    info->name = strdup(name);
+    wl_output_info_set(info, &info->name, name);
 }
 
 static void wl_output_description(void* _, struct wl_output* output, const char* description) {
     wl_output_info* info = (wl_output_info*) _;
-    info->description = strdup(description);
+    wl_output_info_set(info, &info->description, description);
+}
+
+static void wl_output_geometry(void* _, struct wl_output* output, int32_t x, int32_t y, int32_t physical_width, int32_t physical_height,
+        int32_t subpixel, const char* make, const char* model, int32_t transform) {
+    wl_output_info* info = (wl_output_info*) _;
+    info->x = x;
+    info->y = y;
+    info->transform = transform;
+}
+
+static void wl_output_mode(void* _, struct wl_output* output, uint32_t flags, int32_t width, int32_t height, int32_t refresh) {
+    wl_output_info* info = (wl_output_info*) _;
+    if (flags & WL_OUTPUT_MODE_CURRENT) {
+        // the size decides the scale and the refresh the output capture rate, both applied with the layout
+        info->layout_changed |= info->refresh != refresh || info->mode_width != width || info->mode_height != height;
+        info->refresh = refresh;
+        info->mode_width = width;
+        info->mode_height = height;
+    }
+}
+
+static void wl_output_scale(void* _, struct wl_output* output, int32_t factor) {
+    wl_output_info* info = (wl_output_info*) _;
+    info->scale = factor;
 }
 
 static struct wl_output_listener output_listener = {
-    .geometry = noop,
-    .mode = noop,
+    .geometry = wl_output_geometry,
+    .mode = wl_output_mode,
     .done = noop,
-    .scale = noop,
+    .scale = wl_output_scale,
     .name = wl_output_name,
     .description = wl_output_description
 };
 
+static void xdg_output_logical_position(void* _, struct zxdg_output_v1* xdg_output, int32_t x, int32_t y) {
+    wl_output_info* info = (wl_output_info*) _;
+    info->logical_x = x;
+    info->logical_y = y;
+    info->layout_changed = true;
+}
+
+static void xdg_output_logical_size(void* _, struct zxdg_output_v1* xdg_output, int32_t width, int32_t height) {
+    wl_output_info* info = (wl_output_info*) _;
+    info->logical_width = width;
+    info->logical_height = height;
+    info->layout_changed = true;
+}
+
+static struct zxdg_output_v1_listener xdg_output_listener = {
+    .logical_position = xdg_output_logical_position,
+    .logical_size = xdg_output_logical_size,
+    .done = noop,
+    .name = noop,
+    .description = noop
+};
+
+static void wl_output_info_bind_xdg(source_data* data, wl_output_info* info) {
+    if (!data->xdg_output_manager || info->xdg_output)
+        return;
+    info->xdg_output = zxdg_output_manager_v1_get_xdg_output(data->xdg_output_manager, info->output);
+    zxdg_output_v1_add_listener(info->xdg_output, &xdg_output_listener, info);
+}
+
+// foreign toplevels
+
+static void toplevel_info_set(source_data* data, char** field, const char* value) {
+    // properties read the strings from the ui thread
+    pthread_mutex_lock(&data->toplevels_mutex);
+    free(*field);
+    *field = strdup(value);
+    pthread_mutex_unlock(&data->toplevels_mutex);
+}
+
+static void toplevel_info_destroy(toplevel_info* info) {
+    wl_list_remove(&info->link);
+    free(info->title);
+    free(info->app_id);
+    free(info->identifier);
+    ext_foreign_toplevel_handle_v1_destroy(info->handle);
+    bfree(info);
+}
+
+static void toplevel_handle_title(void* _, struct ext_foreign_toplevel_handle_v1* handle, const char* title) {
+    toplevel_info* info = (toplevel_info*) _;
+    toplevel_info_set(info->source, &info->title, title);
+}
+
+static void toplevel_handle_app_id(void* _, struct ext_foreign_toplevel_handle_v1* handle, const char* app_id) {
+    toplevel_info* info = (toplevel_info*) _;
+    toplevel_info_set(info->source, &info->app_id, app_id);
+}
+
+static void toplevel_handle_identifier(void* _, struct ext_foreign_toplevel_handle_v1* handle, const char* identifier) {
+    toplevel_info* info = (toplevel_info*) _;
+    toplevel_info_set(info->source, &info->identifier, identifier);
+}
+
+static void toplevel_handle_done(void* _, struct ext_foreign_toplevel_handle_v1* handle) {
+    toplevel_info* info = (toplevel_info*) _;
+    source_data* data = info->source;
+
+    // pick up a reopened window of the same application
+    pthread_mutex_lock(&data->toplevels_mutex);
+    if (data->capture_type == CAPTURE_WINDOW && !data->capture_toplevel && data->capture_app_id && info->app_id && strcmp(info->app_id, data->capture_app_id) == 0)
+        data->capture_toplevel = info;
+    pthread_mutex_unlock(&data->toplevels_mutex);
+}
+
+static void toplevel_handle_closed(void* _, struct ext_foreign_toplevel_handle_v1* handle) {
+    toplevel_info* info = (toplevel_info*) _;
+    source_data* data = info->source;
+
+    // the capture source refers to the handle, stop the session of the window first, a pending frame will not complete
+    for (uint32_t i = 0; i < MAX_CAPTURE_TARGETS; i++) {
+        capture_target* target = &data->targets[i];
+        if (!target->session.session || target->session.target != info)
+            continue;
+        if (target->frame.frame)
+            screencopy_state_end(&target->frame);
+        capture_session_destroy(&target->session);
+        target->session.target = NULL;
+    }
+
+    pthread_mutex_lock(&data->toplevels_mutex);
+    if (data->capture_toplevel == info)
+        data->capture_toplevel = NULL;
+    toplevel_info_destroy(info);
+    pthread_mutex_unlock(&data->toplevels_mutex);
+}
+
+static struct ext_foreign_toplevel_handle_v1_listener toplevel_handle_listener = {
+    .closed = toplevel_handle_closed,
+    .done = toplevel_handle_done,
+    .title = toplevel_handle_title,
+    .app_id = toplevel_handle_app_id,
+    .identifier = toplevel_handle_identifier
+};
+
+static void toplevel_list_toplevel(void* _, struct ext_foreign_toplevel_list_v1* list, struct ext_foreign_toplevel_handle_v1* handle) {
+    source_data* data = (source_data*) _;
+    toplevel_info* info = bzalloc(sizeof(toplevel_info));
+    info->handle = handle;
+    info->source = data;
+    ext_foreign_toplevel_handle_v1_add_listener(handle, &toplevel_handle_listener, info);
+
+    pthread_mutex_lock(&data->toplevels_mutex);
+    wl_list_insert(&data->toplevels, &info->link);
+    pthread_mutex_unlock(&data->toplevels_mutex);
+}
+
+static struct ext_foreign_toplevel_list_v1_listener toplevel_list_listener = {
+    .toplevel = toplevel_list_toplevel,
+    .finished = noop
+};
+
+static void dmabuf_feedback_format_table(void* _, struct zwp_linux_dmabuf_feedback_v1* feedback, int32_t fd, uint32_t size) {
+    source_data* data = (source_data*) _;
+
+    // 32-bit format, padding and 64-bit modifier per pair, only pairs of formats obs can sample count
+    data->probe.modifier_count = 0;
+    const uint8_t* table = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (table == MAP_FAILED)
+        return;
+    for (uint32_t offset = 0; offset + 16 <= size; offset += 16) {
+        uint32_t format;
+        memcpy(&format, table + offset, sizeof(format));
+        data->probe.modifier_count += format_lookup(format) != NULL;
+    }
+    munmap((void*) table, size);
+}
+
+static void dmabuf_feedback_main_device(void* _, struct zwp_linux_dmabuf_feedback_v1* feedback, struct wl_array* device) {
+    source_data* data = (source_data*) _;
+    if (device->size == sizeof(dev_t))
+        memcpy(&data->compositor_device, device->data, sizeof(dev_t));
+}
+
+static const struct zwp_linux_dmabuf_feedback_v1_listener dmabuf_feedback_listener = {
+    .done = noop,
+    .format_table = dmabuf_feedback_format_table,
+    .main_device = dmabuf_feedback_main_device,
+    .tranche_done = noop,
+    .tranche_target_device = noop,
+    .tranche_formats = noop,
+    .tranche_flags = noop
+};
+
+// wayland seat
+
+static void wl_seat_capabilities(void* _, struct wl_seat* seat, uint32_t capabilities) {
+    source_data* data = (source_data*) _;
+    if ((capabilities & WL_SEAT_CAPABILITY_POINTER) && !data->pointer)
+        data->pointer = wl_seat_get_pointer(seat);
+}
+
+static struct wl_seat_listener seat_listener = {
+    .capabilities = wl_seat_capabilities,
+    .name = noop
+};
+
 // wayland registry
 
 static void wl_registry_global(void* _, struct wl_registry* registry, uint32_t name, const char* interface, uint32_t version) {
@@ -261,12 +2294,51 @@ static void wl_registry_global(void* _, struct wl_registry* registry, uint32_t n
     if (strcmp(interface, wl_output_interface.name) == 0) {
         wl_output_info* output = bzalloc(sizeof(wl_output_info));
         output->output = wl_registry_bind(registry, name, &wl_output_interface, version);
+        output->scale = 1;
+        output->source = data;
         wl_output_add_listener(output->output, &output_listener, output);
+        wl_output_info_bind_xdg(data, output);
+
+        pthread_mutex_lock(&data->outputs_mutex);
         wl_list_insert(&data->outputs, &output->link);
+        pthread_mutex_unlock(&data->outputs_mutex);
     } else if (strcmp(interface, zwlr_screencopy_manager_v1_interface.name) == 0) {
-        data->screencopy_manager = wl_registry_bind(registry, name, &zwlr_screencopy_manager_v1_interface, version);
+        uint32_t bound = version < (uint32_t) zwlr_screencopy_manager_v1_interface.version ? version : (uint32_t) zwlr_screencopy_manager_v1_interface.version;
+        data->screencopy_manager = wl_registry_bind(registry, name, &zwlr_screencopy_manager_v1_interface, bound);
+        data->probe.screencopy_version = version;
     } else if (strcmp(interface, zwp_linux_dmabuf_v1_interface.name) == 0) {
-        data->linux_dmabuf = wl_registry_bind(registry, name, &zwp_linux_dmabuf_v1_interface, version);
+        uint32_t bound = version < (uint32_t) zwp_linux_dmabuf_v1_interface.version ? version : (uint32_t) zwp_linux_dmabuf_v1_interface.version;
+        data->linux_dmabuf = wl_registry_bind(registry, name, &zwp_linux_dmabuf_v1_interface, bound);
+        data->probe.linux_dmabuf_version = version;
+
+        // the feedback names the gpu the compositor renders on
+        if (bound >= ZWP_LINUX_DMABUF_V1_GET_DEFAULT_FEEDBACK_SINCE_VERSION) {
+            data->dmabuf_feedback = zwp_linux_dmabuf_v1_get_default_feedback(data->linux_dmabuf);
+            zwp_linux_dmabuf_feedback_v1_add_listener(data->dmabuf_feedback, &dmabuf_feedback_listener, data);
+        }
+    } else if (strcmp(interface, zxdg_output_manager_v1_interface.name) == 0) {
+        data->xdg_output_manager = wl_registry_bind(registry, name, &zxdg_output_manager_v1_interface, version < 3 ? version : 3);
+
+        // outputs may have been announced before the manager
+        wl_output_info* output;
+        wl_list_for_each(output, &data->outputs, link)
+            wl_output_info_bind_xdg(data, output);
+    } else if (strcmp(interface, wl_shm_interface.name) == 0) {
+        data->shm = wl_registry_bind(registry, name, &wl_shm_interface, 1);
+    } else if (strcmp(interface, ext_image_copy_capture_manager_v1_interface.name) == 0) {
+        data->copy_capture_manager = wl_registry_bind(registry, name, &ext_image_copy_capture_manager_v1_interface, 1);
+        data->probe.copy_capture_version = version;
+    } else if (strcmp(interface, ext_output_image_capture_source_manager_v1_interface.name) == 0) {
+        data->output_source_manager = wl_registry_bind(registry, name, &ext_output_image_capture_source_manager_v1_interface, 1);
+    } else if (strcmp(interface, ext_foreign_toplevel_image_capture_source_manager_v1_interface.name) == 0) {
+        data->toplevel_source_manager = wl_registry_bind(registry, name, &ext_foreign_toplevel_image_capture_source_manager_v1_interface, 1);
+    } else if (strcmp(interface, ext_foreign_toplevel_list_v1_interface.name) == 0) {
+        data->toplevel_list = wl_registry_bind(registry, name, &ext_foreign_toplevel_list_v1_interface, 1);
+        ext_foreign_toplevel_list_v1_add_listener(data->toplevel_list, &toplevel_list_listener, data);
+    } else if (strcmp(interface, wl_seat_interface.name) == 0 && !data->seat) {
+        // cursor sessions follow the pointer of the first seat
+        data->seat = wl_registry_bind(registry, name, &wl_seat_interface, 1);
+        wl_seat_add_listener(data->seat, &seat_listener, data);
     }
 
 }
@@ -276,43 +2348,214 @@ static struct wl_registry_listener listener = {
     .global_remove = noop
 };
 
-// obs source
-
-static void source_update(void* _, obs_data_t* settings);
-static void* source_create(obs_data_t* settings, obs_source_t* source) {
-    source_data* data = bzalloc(sizeof(source_data));
-    wl_list_init(&data->outputs);
-
-    // create gbm device
-    const char* gbm_device = obs_data_get_string(settings, "gbm_device");
-    data->gbm_fd = open((gbm_device && strlen(gbm_device) != 0) ? gbm_device : "/dev/dri/renderD128", O_RDWR);
-    data->gbm = gbm_create_device(data->gbm_fd);
+static bool capture_connect(source_data* data) {
+    // get the shared gbm device, by default on the gpu obs renders on
+    obs_enter_graphics();
+    dev_t renderer = device_renderer();
+    obs_leave_graphics();
+    bool explicit_device = data->connect_gbm_device && strlen(data->connect_gbm_device) != 0;
+    data->gbm = !explicit_device && renderer ? device_acquire_gpu(renderer) : device_acquire(data->connect_gbm_device);
     if (data->gbm == NULL) {
-        blog(LOG_ERROR, "Failed to create GBM device");
-        return data;
+        data->connect_error = "unable to open the GBM device";
+        return false;
     }
 
-    // connect to compositor
-    const char* wl_display = obs_data_get_string(settings, "wl_display");
+    // connect to compositor, replays also run without one
+    const char* name = obs_source_get_name(data->source);
+    const char* wl_display = data->connect_display;
     data->wl = wl_display_connect(wl_display && strlen(wl_display) != 0 ? wl_display : NULL);
-    if (data->wl == NULL) {
-        blog(LOG_ERROR, "Failed to connect to Wayland display");
-        return data;
+    if (data->wl == NULL && data->connect_required) {
+        data->connect_error = "unable to connect to the Wayland display";
+        log_limited(&data->log_failures, name, "Failed to connect to Wayland display");
+        return false;
     }
 
-    // fetch registry
-    struct wl_registry* registry = wl_display_get_registry(data->wl);
-    wl_registry_add_listener(registry, &listener, data);
-    wl_display_roundtrip(data->wl);
-    if (data->screencopy_manager == NULL) {
-        blog(LOG_ERROR, "Failed to bind to screencopy manager");
-        return NULL;
+    if (data->wl) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        uint64_t deadline = ts.tv_sec * 1000000000ULL + ts.tv_nsec + CAPTURE_CONNECT_TIMEOUT_NS;
+
+        // fetch registry
+        data->registry = wl_display_get_registry(data->wl);
+        wl_registry_add_listener(data->registry, &listener, data);
+        if (!capture_roundtrip(data, deadline)) {
+            data->connect_error = "the Wayland display did not answer";
+            if (!data->capture_stopsignal)
+                log_limited(&data->log_failures, name, "Wayland display did not answer within %llu ms", CAPTURE_CONNECT_TIMEOUT_NS / 1000000);
+            return false;
+        }
+
+        // prefer capture sessions over per-frame screencopy
+        data->capture_sessions = data->copy_capture_manager && data->output_source_manager;
+        if (!data->capture_sessions && data->screencopy_manager == NULL) {
+            data->connect_error = "the compositor offers no screen capture protocol";
+            log_limited(&data->log_failures, name, "Failed to bind to screencopy manager");
+            return false;
+        }
+        blog(LOG_INFO, "Capturing through %s", data->capture_sessions ? "ext-image-copy-capture" : "wlr-screencopy");
+
+        // fetch outputs and windows (note: listeners are registered during binding)
+        if (!capture_roundtrip(data, deadline)) {
+            data->connect_error = "the Wayland display did not announce its outputs";
+            if (!data->capture_stopsignal)
+                log_limited(&data->log_failures, name, "Wayland display did not announce its outputs within %llu ms", CAPTURE_CONNECT_TIMEOUT_NS / 1000000);
+            return false;
+        }
+
+        // capture across gpus when the compositor renders on another one than obs, which imports the frames
+        if (data->dmabuf_feedback)
+            zwp_linux_dmabuf_feedback_v1_destroy(data->dmabuf_feedback);
+        data->dmabuf_feedback = NULL;
+        bool other_gpu = data->compositor_device && !device_same_gpu(data->compositor_device, renderer ? renderer : device_number(data->gbm));
+        data->cross_gpu = data->cross_gpu_mode == CROSS_GPU_ALWAYS || (data->cross_gpu_mode == CROSS_GPU_AUTO && other_gpu);
+        if (data->cross_gpu && other_gpu)
+            data->cross_gbm = device_acquire_gpu(data->compositor_device);
+        if (data->cross_gpu)
+            blog(LOG_INFO, "Capturing across gpus, frames are copied into local memory (%s)", data->cross_gbm ? "allocated on the compositor gpu" : "allocated locally");
+
+        // the capture methods are measured once per compositor and driver on the first frames, automatic buffers use the fastest afterwards
+        capture_probe_begin(data);
+    } else {
+        blog(LOG_INFO, "No Wayland display, replaying recorded frames only");
+    }
+
+    // apply the settings again now that outputs and windows are known, obs defers the update to the video thread
+    data->connect_error = NULL;
+    data->connected = true;
+    obs_source_update(data->source, NULL);
+    return true;
+}
+
+static void capture_disconnect(source_data* data) {
+    // destroy all outputs
+    wl_output_info* output, *safe_output;
+    pthread_mutex_lock(&data->outputs_mutex);
+    wl_list_for_each_safe(output, safe_output, &data->outputs, link) {
+        wl_list_remove(&output->link);
+        free(output->name);
+        free(output->description);
+        if (output->xdg_output)
+            zxdg_output_v1_destroy(output->xdg_output);
+        wl_output_destroy(output->output);
+        bfree(output);
     }
+    pthread_mutex_unlock(&data->outputs_mutex);
+
+    // destroy all windows
+    toplevel_info* toplevel, *safe_toplevel;
+    pthread_mutex_lock(&data->toplevels_mutex);
+    data->capture_toplevel = NULL;
+    wl_list_for_each_safe(toplevel, safe_toplevel, &data->toplevels, link)
+        toplevel_info_destroy(toplevel);
+    pthread_mutex_unlock(&data->toplevels_mutex);
+
+    // destroy wayland objects
+    if (data->screencopy_manager)
+        zwlr_screencopy_manager_v1_destroy(data->screencopy_manager);
+    if (data->copy_capture_manager)
+        ext_image_copy_capture_manager_v1_destroy(data->copy_capture_manager);
+    if (data->output_source_manager)
+        ext_output_image_capture_source_manager_v1_destroy(data->output_source_manager);
+    if (data->toplevel_source_manager)
+        ext_foreign_toplevel_image_capture_source_manager_v1_destroy(data->toplevel_source_manager);
+    if (data->toplevel_list)
+        ext_foreign_toplevel_list_v1_destroy(data->toplevel_list);
+    if (data->pointer)
+        wl_pointer_destroy(data->pointer);
+    if (data->seat)
+        wl_seat_destroy(data->seat);
+    if (data->dmabuf_feedback)
+        zwp_linux_dmabuf_feedback_v1_destroy(data->dmabuf_feedback);
+    if (data->linux_dmabuf)
+        zwp_linux_dmabuf_v1_destroy(data->linux_dmabuf);
+    if (data->shm)
+        wl_shm_destroy(data->shm);
+    if (data->xdg_output_manager)
+        zxdg_output_manager_v1_destroy(data->xdg_output_manager);
+    if (data->registry)
+        wl_registry_destroy(data->registry);
+    if (data->wl)
+        wl_display_disconnect(data->wl);
+    data->screencopy_manager = NULL;
+    data->copy_capture_manager = NULL;
+    data->output_source_manager = NULL;
+    data->toplevel_source_manager = NULL;
+    data->toplevel_list = NULL;
+    data->pointer = NULL;
+    data->seat = NULL;
+    data->dmabuf_feedback = NULL;
+    data->linux_dmabuf = NULL;
+    data->shm = NULL;
+    data->xdg_output_manager = NULL;
+    data->registry = NULL;
+    data->wl = NULL;
+    data->capture_sessions = false;
+    data->compositor_device = 0;
+
+    // release gbm devices
+    device_release(data->cross_gbm);
+    device_release(data->gbm);
+    data->cross_gbm = NULL;
+    data->gbm = NULL;
+}
+
+// obs source
 
-    // fetch outputs (note: listeners are registered during binding)
-    wl_display_roundtrip(data->wl);
+static void source_update(void* _, obs_data_t* settings);
+static void* source_create(obs_data_t* settings, obs_source_t* source) {
+    source_data* data = bzalloc(sizeof(source_data));
+    data->source = source;
+    wl_list_init(&data->outputs);
+    wl_list_init(&data->toplevels);
+    pthread_mutex_init(&data->outputs_mutex, NULL);
+    pthread_mutex_init(&data->toplevels_mutex, NULL);
+    pthread_mutex_init(&data->capture_outputs_mutex, NULL);
+    for (int i = 0; i < MAX_CAPTURE_TARGETS; i++)
+        data->targets[i].frame.stats = &data->stats;
+    data->cursor_frame.stats = &data->stats;
+    data->probe_candidate = -1;
+    data->probe.best = -1;
+    data->frame_duration_ns = obs_get_frame_interval_ns(); // paces connection attempts until the settings are applied
+    log_limit_init(&data->log_failures, LOG_ERROR, "capture failures");
+    log_limit_init(&data->log_recoveries, LOG_INFO, "recoveries");
+    log_limit_init(&data->log_buffers, LOG_INFO, "buffer reallocations");
+    log_limit_init(&data->log_slow_frames, LOG_WARNING, "slow frames");
+    log_limit_init(&data->log_updates, LOG_INFO, "settings updates");
+
+    // record frame timelines, allocated up front so recording never locks
+    if (obs_data_get_bool(settings, "trace")) {
+        data->trace = trace_ring_create(TRACE_RING_CAPACITY);
+        data->trace_directory = bstrdup(obs_data_get_string(settings, "trace_directory"));
+        for (int i = 0; i < MAX_CAPTURE_TARGETS; i++) {
+            data->targets[i].frame.trace = data->trace;
+            data->targets[i].frame.trace_track = TRACE_TRACK_TARGET + i;
+        }
+        data->cursor_frame.trace = data->trace;
+        data->cursor_frame.trace_track = TRACE_TRACK_CURSOR;
+    }
 
-    // start capture thread
+    // configure capture buffers
+    data->buffer_count_requested = obs_data_get_int(settings, "buffer_count");
+    if (data->buffer_count_requested < 1 || data->buffer_count_requested > MAX_CAPTURE_BUFFERS)
+        data->buffer_count_requested = 2;
+    data->vram_budget = (uint64_t) obs_data_get_int(settings, "vram_budget") << 20;
+    data->buffer_type = obs_data_get_int(settings, "buffer_type");
+    data->cross_gpu_mode = obs_data_get_int(settings, "cross_gpu");
+
+    // configure capture thread scheduling
+    data->capture_thread_options.policy = obs_data_get_int(settings, "thread_policy");
+    data->capture_thread_options.priority = obs_data_get_int(settings, "thread_priority");
+    data->capture_thread_options.nice = obs_data_get_int(settings, "thread_nice");
+    snprintf(data->capture_thread_options.affinity, sizeof(data->capture_thread_options.affinity), "%s", obs_data_get_string(settings, "thread_affinity"));
+
+    // record captured frames
+    if (obs_data_get_bool(settings, "record") && strlen(obs_data_get_string(settings, "record_path")) != 0)
+        data->record_path = bstrdup(obs_data_get_string(settings, "record_path"));
+
+    // connect on the capture thread, the settings are applied once outputs and windows are known
+    data->connect_gbm_device = bstrdup(obs_data_get_string(settings, "gbm_device"));
+    data->connect_display = bstrdup(obs_data_get_string(settings, "wl_display"));
+    data->connect_required = obs_data_get_int(settings, "capture_type") != CAPTURE_REPLAY;
     pthread_create(&data->capture_thread, NULL, capture_thread, data);
 
     // update source settings
@@ -321,66 +2564,390 @@ static void* source_create(obs_data_t* settings, obs_source_t* source) {
     return data;
 }
 
+static bool source_window_capture_supported(source_data* data) {
+    return data->capture_sessions && data->toplevel_list && data->toplevel_source_manager;
+}
+
+static bool source_cursor_separate_supported(source_data* data) {
+    return cursor_session_supported(data) || (hyprland_available() && data->screencopy_manager);
+}
+
+static void source_update_window(source_data* data, obs_data_t* settings) {
+    // find window by identifier, or another window of the same application once it was reopened
+    const char* identifier = obs_data_get_string(settings, "window");
+    const char* app_id = obs_data_get_string(settings, "window_app_id");
+    toplevel_info* found = NULL;
+    toplevel_info* info;
+
+    pthread_mutex_lock(&data->toplevels_mutex);
+    wl_list_for_each(info, &data->toplevels, link) {
+        if (info->identifier && strcmp(info->identifier, identifier) == 0) {
+            found = info;
+            break;
+        }
+        if (!found && info->app_id && strlen(app_id) != 0 && strcmp(info->app_id, app_id) == 0)
+            found = info;
+    }
+
+    if (found && found->app_id)
+        obs_data_set_string(settings, "window_app_id", found->app_id);
+
+    bfree(data->capture_app_id);
+    data->capture_app_id = bstrdup(found && found->app_id ? found->app_id : app_id);
+    data->capture_toplevel = found;
+    pthread_mutex_unlock(&data->toplevels_mutex);
+
+    if (!found)
+        blog(LOG_WARNING, "Window to capture is not open, waiting for it to appear");
+}
+
+static uint64_t source_frame_duration(source_data* data, obs_data_t* settings) {
+    capture_rate rate = obs_data_get_int(settings, "capture_rate");
+    if (rate == RATE_CUSTOM) {
+        double fps = obs_data_get_double(settings, "capture_fps");
+        if (fps > 0)
+            return (uint64_t) (1000000000.0 / fps);
+    }
+
+    // follow the fastest captured output, the capture thread updates it on mode changes
+    if (rate == RATE_OUTPUT) {
+        pthread_mutex_lock(&data->capture_outputs_mutex);
+        uint64_t duration = capture_outputs_frame_duration(data);
+        pthread_mutex_unlock(&data->capture_outputs_mutex);
+        return duration;
+    }
+
+    return obs_get_frame_interval_ns();
+}
+
+static void source_stats_buffers(source_data* data, uint32_t* used, uint32_t* allocated) {
+    // buffers are in use while obs samples them or the compositor copies into them
+    *used = *allocated = 0;
+    for (uint32_t i = 0; i < data->target_count; i++) {
+        capture_target* target = &data->targets[i];
+        *allocated += target->buffer_count;
+        *used += (target->obs_texture != NULL) + (target->frame.frame && target->frame.copied);
+    }
+}
+
+static void source_stats_collect(void* _, obs_data_t* stats) {
+    source_data* data = (source_data*) _;
+    obs_data_set_string(stats, "name", obs_source_get_name(data->source));
+    obs_data_set_double(stats, "fps", data->stats.fps);
+    obs_data_set_int(stats, "frames", data->stats.frames);
+    obs_data_set_int(stats, "drops", data->stats.drops);
+    obs_data_set_int(stats, "failures", data->stats.failures);
+
+    obs_data_t* latency = obs_data_create();
+    obs_data_set_double(latency, "p50_ms", latency_histogram_percentile(&data->stats.latency, 50) / 1e6);
+    obs_data_set_double(latency, "p95_ms", latency_histogram_percentile(&data->stats.latency, 95) / 1e6);
+    obs_data_set_double(latency, "p99_ms", latency_histogram_percentile(&data->stats.latency, 99) / 1e6);
+    obs_data_set_obj(stats, "latency", latency);
+    obs_data_release(latency);
+
+    uint32_t used, allocated;
+    source_stats_buffers(data, &used, &allocated);
+    obs_data_set_int(stats, "buffers_in_use", used);
+    obs_data_set_int(stats, "buffers", allocated);
+    obs_data_set_int(stats, "vram_bytes", data->vram_usage);
+    obs_data_set_int(stats, "uploaded_bytes", data->stats.uploaded_bytes);
+    obs_data_set_int(stats, "unchanged_frames", data->stats.unchanged_frames);
+    obs_data_set_bool(stats, "thumbnail", capture_thumbnail(data));
+    obs_data_set_bool(stats, "cross_gpu", data->cross_gpu);
+    obs_data_set_double(stats, "cross_copy_ms", data->stats.cross_copies ? data->stats.cross_copy_ns / 1e6 / data->stats.cross_copies : 0.0);
+}
+
 static void source_update(void* _, obs_data_t* settings) {
     source_data* data = (source_data*) _;
+    log_limited_flush(&data->log_updates, obs_source_get_name(data->source));
+
+    // serve statistics through the local socket
+    bool served = obs_data_get_bool(settings, "stats_socket");
+    if (served && !data->stats_served)
+        stats_server_add(data, source_stats_collect);
+    else if (!served && data->stats_served)
+        stats_server_remove(data);
+    data->stats_served = served;
+
+    // outputs and windows are unknown until the capture thread connected, it updates the source again then
+    if (!data->connected)
+        return;
 
-    // find output to capture
+    // find window to capture
+    capture_type type = obs_data_get_int(settings, "capture_type");
+    if (type == CAPTURE_WINDOW && !source_window_capture_supported(data)) {
+        blog(LOG_ERROR, "Window capture requires ext-image-copy-capture and ext-foreign-toplevel-list");
+        return;
+    }
+    if (type == CAPTURE_WINDOW)
+        source_update_window(data, settings);
+
+    // find outputs to capture, the desktop captures every enabled output, outputs without a name yet are still being announced
     const char* output_pattern = obs_data_get_string(settings, "output");
     wl_output_info* output_info = NULL;
+    char key[256];
+    pthread_mutex_lock(&data->outputs_mutex);
+    pthread_mutex_lock(&data->capture_outputs_mutex);
+    data->capture_output_count = 0;
     wl_list_for_each(output_info, &data->outputs, link) {
+        if (!output_info->name)
+            continue;
+
+        snprintf(key, sizeof(key), "desktop_%s", output_info->name);
+        obs_data_set_default_bool(settings, key, true);
+
+        bool selected = type == CAPTURE_DESKTOP ? obs_data_get_bool(settings, key) : type == CAPTURE_OUTPUT && strcmp(output_info->name, output_pattern) == 0;
+        if (selected && data->capture_output_count < MAX_CAPTURE_TARGETS)
+            data->capture_outputs[data->capture_output_count++] = output_info;
+
         if (strcmp(output_info->name, output_pattern) == 0) {
             data->capture_output = output_info->output;
-            break;
+            data->capture_output_name = output_info->name;
         }
     }
-    if (data->capture_output == NULL) {
+    bfree(data->replay_path);
+    data->replay_path = bstrdup(obs_data_get_string(settings, "replay_path"));
+    data->capture_outputs_changed = true;
+    data->capture_wakeup = true;
+    data->capture_type = type;
+    pthread_mutex_unlock(&data->capture_outputs_mutex);
+    pthread_mutex_unlock(&data->outputs_mutex);
+    if ((type == CAPTURE_OUTPUT || type == CAPTURE_DESKTOP) && data->capture_output_count == 0) {
         blog(LOG_ERROR, "Invalid output for screen capture specified");
         return;
     }
 
-    // update frame duration
-    data->frame_duration_ns = obs_get_frame_interval_ns();
-    printf("Frame duration: %lu ns\n", data->frame_duration_ns);
+    // update cursor mode (cursor sessions, otherwise the pointer position through the hyprland ipc and regions through wlr-screencopy)
+    cursor_mode mode = obs_data_get_int(settings, "cursor_mode");
+    if (mode == CURSOR_SEPARATE && type != CAPTURE_OUTPUT) {
+        blog(LOG_WARNING, "Separate cursor capture is only supported for single outputs, drawing cursor into the frame instead");
+        mode = CURSOR_EMBEDDED;
+    } else if (mode == CURSOR_SEPARATE && !source_cursor_separate_supported(data)) {
+        blog(LOG_WARNING, "Separate cursor capture requires ext-image-copy-capture cursor sessions, or Hyprland and wlr-screencopy, drawing cursor into the frame instead");
+        mode = CURSOR_EMBEDDED;
+    }
+    data->cursor_mode = mode;
+
+    // update transfer function of the captured content
+    data->transfer = obs_data_get_int(settings, "transfer");
+    data->capture_scale = obs_data_get_int(settings, "capture_scale");
+    data->thumbnail_tier = obs_data_get_bool(settings, "thumbnail_tier");
+
+    // update frame duration from the capture rate
+    data->capture_rate = obs_data_get_int(settings, "capture_rate");
+    data->frame_duration_ns = source_frame_duration(data, settings);
+    log_limited(&data->log_updates, obs_source_get_name(data->source), "Capturing every %.2f ms", data->frame_duration_ns / 1e6);
+}
 
+static void source_trace_dump(source_data* data) {
+    // one file per source, named after the source
+    const char* directory = data->trace_directory && strlen(data->trace_directory) != 0 ? data->trace_directory : getenv("XDG_RUNTIME_DIR");
+    char name[128], path[1024];
+    snprintf(name, sizeof(name), "%s", obs_source_get_name(data->source));
+    for (char* c = name; *c; c++)
+        if (*c == '/' || *c == ' ')
+            *c = '_';
+    snprintf(path, sizeof(path), "%s/screencopy-trace-%s.json", directory ? directory : "/tmp", name);
+    trace_ring_dump(data->trace, path);
 }
 
 static void source_destroy(void* _) {
     source_data* data = (source_data*) _;
 
+    // stop serving statistics
+    if (data->stats_served)
+        stats_server_remove(data);
+
     // stop capture thread
     data->capture_stopsignal = true;
     pthread_join(data->capture_thread, NULL);
+    source_log_flush(data);
 
-    // destroy all outputs
-    wl_output_info* output, *safe_output;
-    wl_list_for_each_safe(output, safe_output, &data->outputs, link) {
-        wl_list_remove(&output->link);
-        free(output->name);
-        free(output->description);
-        wl_output_destroy(output->output);
-        bfree(output);
+    // write the remaining timeline
+    if (data->trace) {
+        source_trace_dump(data);
+        trace_ring_destroy(data->trace);
+        bfree(data->trace_directory);
     }
 
-    // destroy wayland objects
-    zwlr_screencopy_manager_v1_destroy(data->screencopy_manager);
-    zwp_linux_dmabuf_v1_destroy(data->linux_dmabuf);
-    wl_display_disconnect(data->wl);
-
-    // destroy gbm device
-    gbm_device_destroy(data->gbm);
+    // destroy outputs, windows and wayland objects, and release gbm devices
+    capture_disconnect(data);
+    pthread_mutex_destroy(&data->outputs_mutex);
+    pthread_mutex_destroy(&data->toplevels_mutex);
+    pthread_mutex_destroy(&data->capture_outputs_mutex);
+    bfree(data->capture_app_id);
+    bfree(data->replay_path);
+    bfree(data->record_path);
+    bfree(data->connect_gbm_device);
+    bfree(data->connect_display);
 
     bfree(data);
 }
 
+// obs effect
+
+static gs_effect_t* screencopy_effect = NULL;
+static gs_eparam_t* screencopy_param_image; // looked up once instead of by name on every render
+static gs_eparam_t* screencopy_param_swap_rb;
+static gs_eparam_t* screencopy_param_multiplier;
+static gs_eparam_t* screencopy_param_white_point;
+static gs_eparam_t* screencopy_param_hlg_exponent;
+static gs_eparam_t* screencopy_param_downscale_offset;
+
+static transfer_function source_transfer(source_data* data) {
+    if (data->transfer == TRANSFER_AUTO)
+        return data->obs_linear ? TRANSFER_LINEAR : TRANSFER_SRGB;
+    return data->transfer;
+}
+
+static const char* source_select_technique(source_data* data, gs_effect_t* effect) {
+    // decode, convert and tonemap in the single draw, scaled to the white level of the target space
+    const enum gs_color_space space = gs_get_color_space();
+    const float sdr_white = obs_get_video_sdr_white_level();
+    const float hdr_peak = obs_get_video_hdr_nominal_peak_level();
+    const bool sdr_target = space == GS_CS_SRGB || space == GS_CS_SRGB_16F;
+    const float target_white = space == GS_CS_709_SCRGB ? 80.0f : sdr_white; // nits of 1.0 in the target space
+
+    const char* technique;
+    float content_white; // nits of 1.0 in the decoded content
+    switch (source_transfer(data)) {
+    case TRANSFER_PQ:
+        technique = sdr_target ? "DrawPQTonemap" : "DrawPQ";
+        content_white = 10000.0f;
+        break;
+    case TRANSFER_HLG:
+        technique = sdr_target ? "DrawHLGTonemap" : "DrawHLG";
+        content_white = hdr_peak;
+        break;
+    case TRANSFER_LINEAR:
+        technique = sdr_target ? "DrawLinearTonemap" : "DrawLinear";
+        content_white = 80.0f;
+        break;
+    default:
+        technique = "Draw";
+        content_white = sdr_white;
+        break;
+    }
+
+    gs_effect_set_float(screencopy_param_multiplier, content_white / target_white);
+    gs_effect_set_float(screencopy_param_white_point, hdr_peak / sdr_white);
+    gs_effect_set_float(screencopy_param_hlg_exponent, 0.2f + 0.42f * log10f(hdr_peak / 1000.0f));
+    return technique;
+}
+
+static void source_draw_transformed(gs_texture_t* texture, uint32_t transform, uint32_t flip, uint32_t width, uint32_t height) {
+    // undo the buffer transform in the draw itself, flipped transforms are their own inverse
+    bool flipped = transform & WL_OUTPUT_TRANSFORM_FLIPPED;
+    uint32_t rotation = transform & WL_OUTPUT_TRANSFORM_270;
+    uint32_t undo = flipped ? (4 - rotation) & 3 : rotation;
+    bool rotated = rotation & WL_OUTPUT_TRANSFORM_90;
+    if (flipped)
+        flip ^= GS_FLIP_U;
+
+    switch (undo) {
+    case WL_OUTPUT_TRANSFORM_90: // quarter turn clockwise
+        gs_matrix_translate3f(width, 0.0f, 0.0f);
+        gs_matrix_rotaa4f(0.0f, 0.0f, 1.0f, M_PI / 2);
+        break;
+    case WL_OUTPUT_TRANSFORM_180:
+        gs_matrix_translate3f(width, height, 0.0f);
+        gs_matrix_rotaa4f(0.0f, 0.0f, 1.0f, M_PI);
+        break;
+    case WL_OUTPUT_TRANSFORM_270: // quarter turn counter-clockwise
+        gs_matrix_translate3f(0.0f, height, 0.0f);
+        gs_matrix_rotaa4f(0.0f, 0.0f, 1.0f, -M_PI / 2);
+        break;
+    }
+    gs_draw_sprite(texture, flip, rotated ? height : width, rotated ? width : height);
+}
+
+static gs_texture_t* source_downscale(source_data* data, capture_target* target, gs_texture_t* texture) {
+    // scale every captured frame once, all draws of the source then sample the small texture
+    uint32_t scale = data->capture_scale;
+    if (capture_thumbnail(data) && scale > CAPTURE_THUMBNAIL_SCALE)
+        scale = CAPTURE_THUMBNAIL_SCALE;
+    uint32_t width = gs_texture_get_width(texture) * scale / 100, height = gs_texture_get_height(texture) * scale / 100;
+    if (scale >= 100 || width == 0 || height == 0)
+        return texture;
+    if (target->scaled && target->scaled_source == texture && target->scaled_frame == target->obs_frame
+        && gs_texrender_get_width(target->scaled) == width && gs_texrender_get_height(target->scaled) == height)
+        return gs_texrender_get_texture(target->scaled);
+
+    // render targets need an alpha channel
+    enum gs_color_format format = gs_texture_get_color_format(texture);
+    format = format == GS_BGRX ? GS_BGRA : format;
+    if (target->scaled && gs_texrender_get_format(target->scaled) != format) {
+        gs_texrender_destroy(target->scaled);
+        target->scaled = NULL;
+    }
+
+    // the small texture counts against the budget like the capture buffers, without room frames are drawn at full size
+    uint64_t size = (uint64_t) width * height * (gs_get_format_bpp(format) / 8);
+    if (size != target->scaled_size) {
+        capture_buffer_unreserve(data, target->scaled_size);
+        target->scaled_size = 0;
+        if (!capture_buffer_reserve(data, size)) {
+            gs_texrender_destroy(target->scaled);
+            target->scaled = NULL;
+            target->scaled_source = NULL;
+            return texture;
+        }
+        target->scaled_size = size;
+    }
+    if (!target->scaled)
+        target->scaled = gs_texrender_create(format, GS_ZS_NONE);
+
+    gs_texrender_reset(target->scaled);
+    if (!gs_texrender_begin(target->scaled, width, height))
+        return texture;
+
+    // copy without decoding, the draw converts the small texture like the captured one
+    const bool previous = gs_framebuffer_srgb_enabled();
+    gs_enable_framebuffer_srgb(false);
+    gs_blend_state_push();
+    gs_enable_blending(false);
+    gs_ortho(0.0f, width, 0.0f, height, -100.0f, 100.0f);
+
+    struct vec2 offset;
+    vec2_set(&offset, 0.25f / width, 0.25f / height);
+    gs_effect_set_texture(screencopy_param_image, texture);
+    gs_effect_set_vec2(screencopy_param_downscale_offset, &offset);
+    gs_technique_t* technique = gs_effect_get_technique(screencopy_effect, "Downscale");
+    gs_technique_begin(technique);
+    gs_technique_begin_pass(technique, 0);
+    gs_draw_sprite(texture, 0, width, height);
+    gs_technique_end_pass(technique);
+    gs_technique_end(technique);
+
+    gs_blend_state_pop();
+    gs_enable_framebuffer_srgb(previous);
+    gs_texrender_end(target->scaled);
+
+    target->scaled_source = texture;
+    target->scaled_frame = target->obs_frame;
+    return gs_texrender_get_texture(target->scaled);
+}
+
 static void source_render(void* _, gs_effect_t* effect) {
     source_data* data = (source_data*) _;
-    if (data->obs_texture == NULL) {
+    uint32_t count = data->target_count;
+    if (count == 0 || data->targets[0].obs_texture == NULL) {
         return;
     }
 
+    trace_record(data->trace, TRACE_TRACK_RENDER, TRACE_RENDER, 0);
+    data->rendered_frame = data->stats.frames;
+
+    // downscale new frames before the draw
+    gs_texture_t* textures[MAX_CAPTURE_TARGETS];
+    for (uint32_t i = 0; i < count; i++) {
+        gs_texture_t* texture = data->targets[i].obs_texture;
+        textures[i] = texture ? source_downscale(data, &data->targets[i], texture) : NULL;
+    }
+
     // render texture
-    effect = obs_get_base_effect(OBS_EFFECT_OPAQUE);
-    gs_technique_t* technique = gs_effect_get_technique(effect, "DrawSrgbDecompress");
+    effect = screencopy_effect;
+    gs_technique_t* technique = gs_effect_get_technique(effect, source_select_technique(data, effect));
     gs_technique_begin(technique);
     gs_technique_begin_pass(technique, 0);
 
@@ -388,13 +2955,44 @@ static void source_render(void* _, gs_effect_t* effect) {
     const bool previous = gs_framebuffer_srgb_enabled();
     gs_enable_framebuffer_srgb(linear_srgb);
 
-    gs_eparam_t* image = gs_effect_get_param_by_name(effect, "image");
-    if (linear_srgb)
-        gs_effect_set_texture_srgb(image, data->obs_texture);
-    else
-        gs_effect_set_texture(image, data->obs_texture);
+    // draw every output at its place in the layout
+    gs_eparam_t* image = screencopy_param_image;
+    for (uint32_t i = 0; i < count; i++) {
+        capture_target* target = &data->targets[i];
+        gs_texture_t* texture = textures[i];
+        if (texture == NULL)
+            continue;
+
+        if (linear_srgb)
+            gs_effect_set_texture_srgb(image, texture);
+        else
+            gs_effect_set_texture(image, texture);
+        gs_effect_set_float(screencopy_param_swap_rb, target->obs_swizzle ? 1.0f : 0.0f);
 
-    gs_draw_sprite(data->obs_texture, 0, data->screencopy_frame_width, data->screencopy_frame_height);
+        gs_matrix_push();
+        gs_matrix_translate3f(target->x, target->y, 0.0f);
+        source_draw_transformed(texture, target->obs_transform, target->obs_flip, target->width, target->height);
+        gs_matrix_pop();
+    }
+
+    // composite cursor region, with its own transform and channel order
+    gs_texture_t* cursor_texture = data->cursor_texture;
+    if (cursor_texture) {
+        capture_target* target = &data->targets[0];
+        uint32_t transform = data->cursor_transform;
+        uint32_t width = gs_texture_get_width(cursor_texture), height = gs_texture_get_height(cursor_texture);
+        bool rotated = transform & WL_OUTPUT_TRANSFORM_90;
+        if (linear_srgb)
+            gs_effect_set_texture_srgb(image, cursor_texture);
+        else
+            gs_effect_set_texture(image, cursor_texture);
+        gs_effect_set_float(screencopy_param_swap_rb, data->cursor_swizzle ? 1.0f : 0.0f);
+
+        gs_matrix_push();
+        gs_matrix_translate3f(target->x + data->cursor_x, target->y + data->cursor_y, 0.0f);
+        source_draw_transformed(cursor_texture, transform, data->cursor_flip, rotated ? height : width, rotated ? width : height);
+        gs_matrix_pop();
+    }
 
     gs_enable_framebuffer_srgb(previous);
 
@@ -402,40 +3000,257 @@ static void source_render(void* _, gs_effect_t* effect) {
     gs_technique_end(technique);
 }
 
+static bool source_capture_rate_modified(obs_properties_t* properties, obs_property_t* property, obs_data_t* settings) {
+    obs_property_set_visible(obs_properties_get(properties, "capture_fps"), obs_data_get_int(settings, "capture_rate") == RATE_CUSTOM);
+    return true;
+}
+
+static bool source_capture_type_modified(obs_properties_t* properties, obs_property_t* property, obs_data_t* settings) {
+    capture_type type = obs_data_get_int(settings, "capture_type");
+    obs_property_set_visible(obs_properties_get(properties, "output"), type == CAPTURE_OUTPUT);
+    obs_property_set_visible(obs_properties_get(properties, "window"), type == CAPTURE_WINDOW);
+    obs_property_set_visible(obs_properties_get(properties, "desktop"), type == CAPTURE_DESKTOP);
+    obs_property_set_visible(obs_properties_get(properties, "replay_path"), type == CAPTURE_REPLAY);
+    return true;
+}
+
+static bool source_stats_refresh_clicked(obs_properties_t* properties, obs_property_t* property, void* _) {
+    return true;
+}
+
+static bool source_trace_dump_clicked(obs_properties_t* properties, obs_property_t* property, void* _) {
+    source_trace_dump((source_data*) _);
+    return false;
+}
+
 static obs_properties_t* source_get_properties(void* _) {
     source_data* data = (source_data*) _;
     obs_properties_t* properties = obs_properties_create();
 
+    // add capture type property
+    obs_property_t* type = obs_properties_add_list(properties, "capture_type", "Capture", OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+    obs_property_list_add_int(type, "Output", CAPTURE_OUTPUT);
+    if (source_window_capture_supported(data))
+        obs_property_list_add_int(type, "Window", CAPTURE_WINDOW);
+    obs_property_list_add_int(type, "Desktop (multiple outputs)", CAPTURE_DESKTOP);
+    obs_property_list_add_int(type, "Replay recording", CAPTURE_REPLAY);
+    obs_property_set_modified_callback(type, source_capture_type_modified);
+
+    // outputs and windows are listed once the capture thread connected
+    const char* connect_error = data->connect_error;
+    if (!data->connected) {
+        char status[256];
+        snprintf(status, sizeof(status), connect_error ? "Not connected, %s. Retrying in the background" : "Connecting to the Wayland display", connect_error);
+        obs_properties_add_text(properties, "connect_status", status, OBS_TEXT_INFO);
+    }
+
     // add output list property
+    // add output list and desktop output selection, outputs are enumerated on the capture thread
     obs_property_t* output = obs_properties_add_list(properties, "output", "Output", OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
+    obs_properties_t* desktop = obs_properties_create();
     wl_output_info* info;
     char label[1024];
+    char key[256];
+    pthread_mutex_lock(&data->outputs_mutex);
     wl_list_for_each(info, &data->outputs, link) {
+        if (!info->name)
+            continue;
         snprintf(label, sizeof(label), "%s: %s", info->name, info->description ? info->description : "no description");
         obs_property_list_add_string(output, label, info->name);
+        snprintf(key, sizeof(key), "desktop_%s", info->name);
+        obs_properties_add_bool(desktop, key, label);
+    }
+    pthread_mutex_unlock(&data->outputs_mutex);
+    obs_properties_add_group(properties, "desktop", "Desktop Outputs", OBS_GROUP_NORMAL, desktop);
+
+    // add window list property
+    obs_property_t* window = obs_properties_add_list(properties, "window", "Window", OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
+    toplevel_info* toplevel;
+    pthread_mutex_lock(&data->toplevels_mutex);
+    wl_list_for_each(toplevel, &data->toplevels, link) {
+        if (!toplevel->identifier)
+            continue;
+        snprintf(label, sizeof(label), "[%s] %s", toplevel->app_id ? toplevel->app_id : "unknown", toplevel->title ? toplevel->title : "untitled");
+        obs_property_list_add_string(window, label, toplevel->identifier);
     }
+    pthread_mutex_unlock(&data->toplevels_mutex);
+
+    // add replay file property
+    obs_properties_add_path(properties, "replay_path", "Recording", OBS_PATH_FILE, "Screencopy recordings (*.screc);;All files (*)", NULL);
+
+    // add cursor mode property
+    obs_property_t* cursor = obs_properties_add_list(properties, "cursor_mode", "Cursor", OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+    obs_property_list_add_int(cursor, "Hidden", CURSOR_HIDDEN);
+    obs_property_list_add_int(cursor, "Embedded in frame", CURSOR_EMBEDDED);
+    size_t separate = obs_property_list_add_int(cursor, "Separate layer", CURSOR_SEPARATE);
+    obs_property_list_item_disable(cursor, separate, !source_cursor_separate_supported(data));
+    obs_property_set_long_description(cursor, "A separate layer only recopies the cursor image when it changes and moves it with the pointer. "
+        "It requires cursor sessions of ext-image-copy-capture, or Hyprland with wlr-screencopy, and is unavailable otherwise");
+
+    // add capture rate property
+    obs_property_t* rate = obs_properties_add_list(properties, "capture_rate", "Capture Rate", OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+    obs_property_list_add_int(rate, "OBS frame rate", RATE_OBS);
+    obs_property_list_add_int(rate, "Output refresh rate", RATE_OUTPUT);
+    obs_property_list_add_int(rate, "Custom", RATE_CUSTOM);
+    obs_property_set_modified_callback(rate, source_capture_rate_modified);
+    obs_property_t* fps = obs_properties_add_float(properties, "capture_fps", "Frames per Second", 0.1, 480.0, 0.01);
+    obs_property_float_set_suffix(fps, " fps");
+
+    // add capture scale property
+    obs_property_t* capture_scale = obs_properties_add_int_slider(properties, "capture_scale", "Capture Scale", 10, 100, 5);
+    obs_property_int_set_suffix(capture_scale, "%");
+    obs_property_set_long_description(capture_scale, "Downscales every captured frame once on the GPU, so scenes showing the source smaller than its size sample a smaller texture");
+    obs_property_t* thumbnail = obs_properties_add_bool(properties, "thumbnail_tier", "Capture Thumbnails When Not in Program");
+    obs_property_set_long_description(thumbnail, "While only the preview, projectors or the multiview show the source it is captured at 2 fps and drawn from a quarter size texture, going live restores the full rate immediately");
+
+    // add transfer function property
+    obs_property_t* transfer = obs_properties_add_list(properties, "transfer", "Transfer Function", OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+    obs_property_list_add_int(transfer, "Automatic", TRANSFER_AUTO);
+    obs_property_list_add_int(transfer, "sRGB (SDR)", TRANSFER_SRGB);
+    obs_property_list_add_int(transfer, "PQ (HDR10)", TRANSFER_PQ);
+    obs_property_list_add_int(transfer, "HLG", TRANSFER_HLG);
+    obs_property_list_add_int(transfer, "Linear (scRGB)", TRANSFER_LINEAR);
+    obs_property_set_long_description(transfer, "Wayland does not report how an output is encoded, automatic assumes sRGB and linear for floating point formats");
+
+    // add live statistics, rebuilt by the refresh button
+    obs_properties_t* statistics = obs_properties_create();
+    capture_stats stats = data->stats;
+    snprintf(label, sizeof(label), "Capture rate: %.1f fps (%lu frames, %lu dropped before render, %lu failed)",
+        stats.fps, stats.frames, stats.drops, stats.failures);
+    obs_properties_add_text(statistics, "stats_rate", label, OBS_TEXT_INFO);
+
+    snprintf(label, sizeof(label), "Capture latency: %.2f ms median, %.2f ms p95, %.2f ms p99",
+        latency_histogram_percentile(&stats.latency, 50) / 1e6, latency_histogram_percentile(&stats.latency, 95) / 1e6,
+        latency_histogram_percentile(&stats.latency, 99) / 1e6);
+    obs_properties_add_text(statistics, "stats_latency", label, OBS_TEXT_INFO);
+
+    uint32_t buffers_used, buffers_allocated;
+    source_stats_buffers(data, &buffers_used, &buffers_allocated);
+    snprintf(label, sizeof(label), "Buffer ring: %u of %u buffers in use", buffers_used, buffers_allocated);
+    obs_properties_add_text(statistics, "stats_buffers", label, OBS_TEXT_INFO);
+
+    snprintf(label, sizeof(label), "VRAM usage: %.1f MiB (all sources: %.1f MiB)",
+        data->vram_usage / 1048576.0, vram_usage_total / 1048576.0);
+    obs_properties_add_text(statistics, "vram_usage", label, OBS_TEXT_INFO);
+
+    // per frame cost of the capture thread, requests and syscalls are counted where the plugin issues them
+    double frames = stats.frames ? (double) stats.frames : 1.0;
+    snprintf(label, sizeof(label), "Estimated per frame: %.1f Wayland requests, %.1f objects, %.1f syscalls, %.1f KiB uploaded (%lu buffer allocations)",
+        stats.requests / frames, stats.objects / frames, stats.syscalls / frames, stats.uploaded_bytes / frames / 1024.0, stats.allocations);
+    obs_property_t* frame_cost = obs_properties_add_text(statistics, "frame_cost", label, OBS_TEXT_INFO);
+    obs_property_set_long_description(frame_cost, "Requests, objects and syscalls are estimates counted where the plugin issues them, "
+        "work done inside libwayland, Mesa or the kernel is not included. Uploads and allocations are exact");
+
+    double wakeups = stats.wakeups ? (double) stats.wakeups : 1.0;
+    snprintf(label, sizeof(label), "Wakeup latency: %.0f us average, %.0f us max",
+        stats.wakeup_latency_ns / wakeups / 1000.0, stats.wakeup_latency_max_ns / 1000.0);
+    obs_properties_add_text(statistics, "wakeup_latency", label, OBS_TEXT_INFO);
+
+    obs_properties_add_button2(statistics, "stats_refresh", "Refresh", source_stats_refresh_clicked, data);
+    if (data->trace)
+        obs_properties_add_button2(statistics, "trace_dump", "Write Capture Trace", source_trace_dump_clicked, data);
+    obs_property_t* socket = obs_properties_add_bool(statistics, "stats_socket", "Serve Statistics on Local Socket");
+    snprintf(label, sizeof(label), "Every connection to %s receives the statistics of all serving sources as JSON", stats_server_path());
+    obs_property_set_long_description(socket, label);
+    obs_properties_add_group(properties, "statistics", "Statistics", OBS_GROUP_NORMAL, statistics);
 
     // add gbm and wayland device properties
     obs_properties_t* advanced = obs_properties_create();
-    obs_properties_add_text(advanced, "gbm_device", "GBM Device", OBS_TEXT_DEFAULT);
+    obs_property_t* gbm_device = obs_properties_add_text(advanced, "gbm_device", "GBM Device", OBS_TEXT_DEFAULT);
+    obs_property_set_long_description(gbm_device, "Render node capture buffers are allocated on, empty uses the GPU OBS renders on");
     obs_properties_add_text(advanced, "wl_display", "Wayland Display", OBS_TEXT_DEFAULT);
+    obs_properties_add_int(advanced, "buffer_count", "Capture Buffers", 1, MAX_CAPTURE_BUFFERS, 1);
+    obs_property_t* buffer_type = obs_properties_add_list(advanced, "buffer_type", "Buffer Type", OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+    obs_property_list_add_int(buffer_type, "Automatic", BUFFER_AUTO);
+    obs_property_list_add_int(buffer_type, "DMA-BUF", BUFFER_DMABUF);
+    obs_property_list_add_int(buffer_type, "Shared memory", BUFFER_SHM);
+    obs_property_set_long_description(buffer_type, "Shared memory frames are sampled by OBS where the compositor wrote them if /dev/udmabuf is accessible, otherwise only damaged tiles are uploaded to the GPU. Automatic measures every capture protocol and buffer type the compositor offers once and uses the fastest, the result is cached per compositor and driver");
+    obs_property_t* cross_gpu = obs_properties_add_list(advanced, "cross_gpu", "Cross-GPU Capture", OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+    obs_property_list_add_int(cross_gpu, "Automatic", CROSS_GPU_AUTO);
+    obs_property_list_add_int(cross_gpu, "Off", CROSS_GPU_OFF);
+    obs_property_list_add_int(cross_gpu, "Always", CROSS_GPU_ALWAYS);
+    obs_property_set_long_description(cross_gpu, "Frames are captured into linear buffers on the compositor GPU and copied once into local memory of the GBM device, which should be the GPU OBS renders on. Automatic enables it when the compositor renders on another GPU, Always allows comparing both paths");
+    obs_property_t* budget = obs_properties_add_int(advanced, "vram_budget", "VRAM Budget (all sources)", 0, 65536, 64);
+    obs_property_int_set_suffix(budget, " MiB");
+    obs_property_set_long_description(budget, "Capture buffers, upload, cross-GPU and downscaled textures are not allocated past this total, 0 disables the limit");
+    obs_property_t* policy = obs_properties_add_list(advanced, "thread_policy", "Capture Thread Scheduling", OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+    obs_property_list_add_int(policy, "Normal", THREAD_POLICY_NORMAL);
+    obs_property_list_add_int(policy, "Realtime (SCHED_RR)", THREAD_POLICY_RR);
+    obs_property_list_add_int(policy, "Realtime (SCHED_FIFO)", THREAD_POLICY_FIFO);
+    obs_property_set_long_description(policy, "Realtime scheduling requires CAP_SYS_NICE or an rtprio limit, the nice level is used when it is not permitted");
+    obs_properties_add_int(advanced, "thread_priority", "Realtime Priority", 1, 99, 1);
+    obs_properties_add_int(advanced, "thread_nice", "Nice Level", -20, 19, 1);
+    obs_property_t* affinity = obs_properties_add_text(advanced, "thread_affinity", "CPU Affinity", OBS_TEXT_DEFAULT);
+    obs_property_set_long_description(affinity, "List of CPUs like 2,3 or 4-7, empty for all CPUs");
+    obs_property_t* trace = obs_properties_add_bool(advanced, "trace", "Record Capture Trace");
+    obs_property_set_long_description(trace, "Records requests, copies, compositor timestamps and render ticks, written as Chrome trace JSON on demand and when the source is destroyed");
+    obs_properties_add_path(advanced, "trace_directory", "Trace Directory", OBS_PATH_DIRECTORY, NULL, NULL);
+    obs_property_t* record = obs_properties_add_bool(advanced, "record", "Record Captured Frames");
+    obs_property_set_long_description(record, "Records the damaged pixels and timestamps of every frame of a single output or window for the replay capture type, reading frames back slows down the capture");
+    obs_properties_add_path(advanced, "record_path", "Recording File", OBS_PATH_FILE_SAVE, "Screencopy recordings (*.screc)", NULL);
     obs_properties_add_group(properties, "advanced", "Advanced Settings (requires restart)", OBS_GROUP_NORMAL, advanced);
 
     return properties;
 }
 
 static void source_get_defaults(obs_data_t* settings) {
+    obs_data_set_default_int(settings, "capture_type", CAPTURE_OUTPUT);
     obs_data_set_default_string(settings, "output", "");
+    obs_data_set_default_string(settings, "window", "");
+    obs_data_set_default_string(settings, "window_app_id", "");
+    obs_data_set_default_string(settings, "replay_path", "");
+    obs_data_set_default_int(settings, "cursor_mode", CURSOR_HIDDEN);
+    obs_data_set_default_int(settings, "capture_rate", RATE_OBS);
+    obs_data_set_default_double(settings, "capture_fps", 30.0);
+    obs_data_set_default_int(settings, "transfer", TRANSFER_AUTO);
+    obs_data_set_default_int(settings, "capture_scale", 100);
+    obs_data_set_default_bool(settings, "thumbnail_tier", false);
     obs_data_set_default_string(settings, "gbm_device", NULL);
     obs_data_set_default_string(settings, "wl_display", NULL);
+    obs_data_set_default_int(settings, "buffer_count", 2);
+    obs_data_set_default_int(settings, "buffer_type", BUFFER_AUTO);
+    obs_data_set_default_int(settings, "cross_gpu", CROSS_GPU_AUTO);
+    obs_data_set_default_int(settings, "vram_budget", 0);
+    obs_data_set_default_int(settings, "thread_policy", THREAD_POLICY_NORMAL);
+    obs_data_set_default_int(settings, "thread_priority", 10);
+    obs_data_set_default_int(settings, "thread_nice", 0);
+    obs_data_set_default_string(settings, "thread_affinity", "");
+    obs_data_set_default_bool(settings, "stats_socket", false);
+    obs_data_set_default_bool(settings, "trace", false);
+    obs_data_set_default_string(settings, "trace_directory", "");
+    obs_data_set_default_bool(settings, "record", false);
+    obs_data_set_default_string(settings, "record_path", "");
 }
 
 // obs source definition
 
+static void source_activate(void* _) {
+    source_data* data = (source_data*) _;
+    data->capture_live = true;
+    data->capture_wakeup = true;
+    blog(LOG_DEBUG, "Source %s went live, capturing at full rate", obs_source_get_name(data->source));
+}
+
+static void source_deactivate(void* _) {
+    source_data* data = (source_data*) _;
+    data->capture_live = false;
+    blog(LOG_DEBUG, "Source %s left program", obs_source_get_name(data->source));
+}
+
 static const char* source_get_name(void* _) { return "Screencopy Source"; }
-static uint32_t source_get_width(void* _) { return ((source_data*) _)->screencopy_frame_width; }
-static uint32_t source_get_height(void* _) { return ((source_data*) _)->screencopy_frame_height; }
-static enum gs_color_space source_get_color_space(void* _, size_t count, const enum gs_color_space *preferred_spaces) { return ((source_data*) _)->obs_color_space; }
+static uint32_t source_get_width(void* _) { return ((source_data*) _)->width; }
+static uint32_t source_get_height(void* _) { return ((source_data*) _)->height; }
+static enum gs_color_space source_get_color_space(void* _, size_t count, const enum gs_color_space *preferred_spaces) {
+    source_data* data = (source_data*) _;
+    if (source_transfer(data) == TRANSFER_SRGB)
+        return data->obs_color_space;
+
+    // render hdr content directly into an hdr space if obs offers one, otherwise tonemap while drawing
+    for (size_t i = 0; i < count; i++)
+        if (preferred_spaces[i] == GS_CS_709_EXTENDED || preferred_spaces[i] == GS_CS_709_SCRGB)
+            return preferred_spaces[i];
+    return GS_CS_SRGB;
+}
 static struct obs_source_info source_info = {
     .id = "screencopy-source",
     .version = 1,
@@ -448,6 +3263,8 @@ static struct obs_source_info source_info = {
     .create = source_create,
     .update = source_update,
     .destroy = source_destroy,
+    .activate = source_activate,
+    .deactivate = source_deactivate,
     .video_render = source_render,
 
     .get_properties = source_get_properties,
@@ -461,6 +3278,33 @@ static struct obs_source_info source_info = {
 // obs module
 
 bool obs_module_load() {
+    // compile render effect and query importable formats
+    char* error = NULL;
+    obs_enter_graphics();
+    screencopy_effect = gs_effect_create(screencopy_effect_source, "screencopy.effect", &error);
+    if (screencopy_effect) {
+        screencopy_param_image = gs_effect_get_param_by_name(screencopy_effect, "image");
+        screencopy_param_swap_rb = gs_effect_get_param_by_name(screencopy_effect, "swap_rb");
+        screencopy_param_multiplier = gs_effect_get_param_by_name(screencopy_effect, "multiplier");
+        screencopy_param_white_point = gs_effect_get_param_by_name(screencopy_effect, "white_point");
+        screencopy_param_hlg_exponent = gs_effect_get_param_by_name(screencopy_effect, "hlg_exponent");
+        screencopy_param_downscale_offset = gs_effect_get_param_by_name(screencopy_effect, "downscale_offset");
+    }
+    format_query_dmabuf_support();
+    obs_leave_graphics();
+    if (screencopy_effect == NULL) {
+        blog(LOG_ERROR, "Failed to compile screencopy effect: %s", error ? error : "unknown error");
+        bfree(error);
+        return false;
+    }
+
     obs_register_source(&source_info);
     return true;
+}
+
+void obs_module_unload() {
+    obs_enter_graphics();
+    gs_effect_destroy(screencopy_effect);
+    format_free_dmabuf_support();
+    obs_leave_graphics();
 }
\ No newline at end of file
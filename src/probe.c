@@ -0,0 +1,230 @@
+#include "probe.h"
+
+#include <obs/obs.h>
+#include <obs/util/base.h>
+#include <obs/util/platform.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PROBE_MAX_DISPLAYS 16
+
+typedef struct {
+    char key[256];
+    bool busy; // claimed by a source that is probing
+    bool valid; // result is known, possibly without a working candidate
+    probe_result result;
+} probe_entry;
+
+static probe_entry probe_entries[PROBE_MAX_DISPLAYS];
+static uint32_t probe_entry_count = 0;
+static pthread_mutex_t probe_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// candidates
+
+void probe_candidates_init(probe_result* result, bool sessions, bool screencopy, bool dmabuf, bool shm) {
+    result->candidate_count = 0;
+    result->best = -1;
+    for (int protocol = 0; protocol < 2; protocol++) {
+        if (protocol == 0 ? !sessions : !screencopy)
+            continue;
+
+        // dma-buf first, shared memory is the fallback
+        for (int buffer = 0; buffer < 2; buffer++) {
+            if (buffer == 0 ? !dmabuf : !shm)
+                continue;
+
+            probe_candidate* candidate = &result->candidates[result->candidate_count++];
+            memset(candidate, 0, sizeof(probe_candidate));
+            candidate->sessions = protocol == 0;
+            candidate->shm = buffer == 1;
+        }
+    }
+}
+
+bool probe_select(probe_result* result) {
+    result->best = -1;
+    for (uint32_t i = 0; i < result->candidate_count; i++) {
+        const probe_candidate* candidate = &result->candidates[i];
+        if (candidate->works && (result->best < 0 || candidate->latency_ms < result->candidates[result->best].latency_ms))
+            result->best = i;
+    }
+    return result->best >= 0;
+}
+
+const char* probe_candidate_name(const probe_candidate* candidate) {
+    if (candidate->sessions)
+        return candidate->shm ? "ext-image-copy-capture with shared memory" : "ext-image-copy-capture with DMA-BUF";
+    return candidate->shm ? "wlr-screencopy with shared memory" : "wlr-screencopy with DMA-BUF";
+}
+
+void probe_log(const char* source, const probe_result* result, bool cached) {
+    blog(LOG_INFO, "[%s] Compositor offers wlr-screencopy v%u, linux-dmabuf v%u, ext-image-copy-capture v%u, DMA-BUF format %.4s, shared memory format %.4s, %u format modifiers%s",
+        source, result->screencopy_version, result->linux_dmabuf_version, result->copy_capture_version,
+        result->dmabuf_format ? (const char*) &result->dmabuf_format : "none", result->shm_offered ? (const char*) &result->shm_format : "none",
+        result->modifier_count, cached ? " (cached)" : "");
+
+    for (uint32_t i = 0; i < result->candidate_count; i++) {
+        const probe_candidate* candidate = &result->candidates[i];
+        if (candidate->works)
+            blog(LOG_INFO, "[%s] %s: %.2f ms%s", source, probe_candidate_name(candidate), candidate->latency_ms, (int32_t) i == result->best ? ", selected" : "");
+        else
+            blog(LOG_INFO, "[%s] %s: not working", source, probe_candidate_name(candidate));
+    }
+}
+
+// on-disk cache
+
+void probe_key(char* key, size_t size, const probe_result* result, const char* driver) {
+    const char* desktop = getenv("XDG_CURRENT_DESKTOP");
+    snprintf(key, size, "%s/%s/screencopy-%u/dmabuf-%u/copy-capture-%u", desktop && strlen(desktop) != 0 ? desktop : "unknown", driver,
+        result->screencopy_version, result->linux_dmabuf_version, result->copy_capture_version);
+}
+
+static void probe_cache_path(char* path, size_t size) {
+    const char* cache_dir = getenv("XDG_CACHE_HOME");
+    const char* home = getenv("HOME");
+    if (cache_dir && strlen(cache_dir) != 0)
+        snprintf(path, size, "%s/obs-screencopy/probe.json", cache_dir);
+    else
+        snprintf(path, size, "%s/.cache/obs-screencopy/probe.json", home ? home : "/tmp");
+}
+
+static obs_data_t* probe_cache_read(const char* path) {
+    char* json = os_quick_read_utf8_file(path);
+    obs_data_t* cache = json ? obs_data_create_from_json(json) : NULL;
+    bfree(json);
+    return cache ? cache : obs_data_create();
+}
+
+static bool probe_cache_load(const char* key, probe_result* result) {
+    char path[512];
+    probe_cache_path(path, sizeof(path));
+
+    obs_data_t* cache = probe_cache_read(path);
+    obs_data_t* entry = obs_data_get_obj(cache, key);
+    obs_data_release(cache);
+    if (!entry)
+        return false;
+
+    result->dmabuf_format = obs_data_get_int(entry, "dmabuf_format");
+    result->shm_format = obs_data_get_int(entry, "shm_format");
+    result->shm_offered = obs_data_get_bool(entry, "shm_offered");
+    result->modifier_count = obs_data_get_int(entry, "modifier_count");
+    result->candidate_count = 0;
+
+    obs_data_array_t* candidates = obs_data_get_array(entry, "candidates");
+    size_t count = candidates ? obs_data_array_count(candidates) : 0;
+    for (size_t i = 0; i < count && result->candidate_count < PROBE_CANDIDATES; i++) {
+        obs_data_t* item = obs_data_array_item(candidates, i);
+        probe_candidate* candidate = &result->candidates[result->candidate_count++];
+        candidate->sessions = obs_data_get_bool(item, "sessions");
+        candidate->shm = obs_data_get_bool(item, "shm");
+        candidate->works = obs_data_get_bool(item, "works");
+        candidate->latency_ms = obs_data_get_double(item, "latency_ms");
+        obs_data_release(item);
+    }
+    obs_data_array_release(candidates);
+    obs_data_release(entry);
+
+    // entries without a working candidate are never stored, treat them as missing
+    return probe_select(result);
+}
+
+static void probe_cache_save(const char* key, const probe_result* result) {
+    char path[512];
+    probe_cache_path(path, sizeof(path));
+
+    obs_data_t* entry = obs_data_create();
+    obs_data_set_int(entry, "screencopy_version", result->screencopy_version);
+    obs_data_set_int(entry, "linux_dmabuf_version", result->linux_dmabuf_version);
+    obs_data_set_int(entry, "copy_capture_version", result->copy_capture_version);
+    obs_data_set_int(entry, "dmabuf_format", result->dmabuf_format);
+    obs_data_set_int(entry, "shm_format", result->shm_format);
+    obs_data_set_bool(entry, "shm_offered", result->shm_offered);
+    obs_data_set_int(entry, "modifier_count", result->modifier_count);
+
+    obs_data_array_t* candidates = obs_data_array_create();
+    for (uint32_t i = 0; i < result->candidate_count; i++) {
+        const probe_candidate* candidate = &result->candidates[i];
+        obs_data_t* item = obs_data_create();
+        obs_data_set_string(item, "name", probe_candidate_name(candidate));
+        obs_data_set_bool(item, "sessions", candidate->sessions);
+        obs_data_set_bool(item, "shm", candidate->shm);
+        obs_data_set_bool(item, "works", candidate->works);
+        obs_data_set_double(item, "latency_ms", candidate->latency_ms);
+        obs_data_array_push_back(candidates, item);
+        obs_data_release(item);
+    }
+    obs_data_set_array(entry, "candidates", candidates);
+    obs_data_array_release(candidates);
+
+    // merge into the entries of other compositors and drivers, written through a temporary file
+    obs_data_t* cache = probe_cache_read(path);
+    obs_data_set_obj(cache, key, entry);
+
+    char directory[512];
+    snprintf(directory, sizeof(directory), "%s", path);
+    *strrchr(directory, '/') = '\0';
+    const char* json = obs_data_get_json(cache);
+    if (os_mkdirs(directory) == MKDIR_ERROR || !os_quick_write_utf8_file_safe(path, json, strlen(json), false, "tmp", NULL))
+        blog(LOG_WARNING, "Failed to write capability probe cache %s", path);
+
+    obs_data_release(cache);
+    obs_data_release(entry);
+}
+
+// shared probes
+
+static probe_entry* probe_entry_find(const char* key) {
+    for (uint32_t i = 0; i < probe_entry_count; i++)
+        if (strcmp(probe_entries[i].key, key) == 0)
+            return &probe_entries[i];
+
+    if (probe_entry_count == PROBE_MAX_DISPLAYS)
+        return NULL;
+    probe_entry* entry = &probe_entries[probe_entry_count++];
+    memset(entry, 0, sizeof(probe_entry));
+    snprintf(entry->key, sizeof(entry->key), "%s", key);
+    return entry;
+}
+
+probe_claim_result probe_claim(const char* key, probe_result* result) {
+    pthread_mutex_lock(&probe_cache_mutex);
+    probe_entry* entry = probe_entry_find(key);
+    probe_claim_result claim = PROBE_CLAIM_OWNER;
+    if (entry && entry->valid) {
+        *result = entry->result;
+        claim = PROBE_CLAIM_CACHED;
+    } else if (entry && entry->busy) {
+        claim = PROBE_CLAIM_BUSY;
+    } else if (probe_cache_load(key, result)) {
+        // probed by an earlier launch
+        if (entry) {
+            entry->result = *result;
+            entry->valid = true;
+        }
+        claim = PROBE_CLAIM_CACHED;
+    } else if (entry) {
+        entry->busy = true;
+    }
+    pthread_mutex_unlock(&probe_cache_mutex);
+    return claim;
+}
+
+void probe_release(const char* key, const probe_result* result) {
+    pthread_mutex_lock(&probe_cache_mutex);
+    probe_entry* entry = probe_entry_find(key);
+    if (entry) {
+        entry->busy = false;
+        entry->valid = result != NULL;
+        if (result)
+            entry->result = *result;
+    }
+
+    // inconclusive probes are only kept for this launch
+    if (result && result->best >= 0)
+        probe_cache_save(key, result);
+    pthread_mutex_unlock(&probe_cache_mutex);
+}
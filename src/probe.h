@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define PROBE_CANDIDATES 4 // capture protocol and buffer type combinations
+#define PROBE_FRAMES 8 // frames measured per candidate
+#define PROBE_CANDIDATE_TIMEOUT_NS 1000000000ULL // static screens deliver few frames, judge a candidate after 1 s
+
+typedef struct {
+    bool sessions; // ext-image-copy-capture instead of wlr-screencopy
+    bool shm; // shared memory instead of dma-buf
+    bool works; // delivered frames without failing
+    double latency_ms; // average from the request to the copied frame
+} probe_candidate;
+
+typedef struct {
+    uint32_t screencopy_version; // advertised by the compositor, 0 if missing
+    uint32_t linux_dmabuf_version;
+    uint32_t copy_capture_version;
+    uint32_t dmabuf_format; // offered for the probed frames, 0 if none
+    uint32_t shm_format;
+    bool shm_offered;
+    uint32_t modifier_count; // format and modifier pairs of the dma-buf feedback with a format obs can sample
+
+    probe_candidate candidates[PROBE_CANDIDATES];
+    uint32_t candidate_count;
+    int32_t best; // fastest working candidate, -1 if none works
+} probe_result;
+
+// list the candidates the bound globals allow, sessions first
+void probe_candidates_init(probe_result* result, bool sessions, bool screencopy, bool dmabuf, bool shm);
+
+// pick the fastest working candidate, returns false if none works
+bool probe_select(probe_result* result);
+
+// description of a candidate, e.g. "wlr-screencopy with DMA-BUF"
+const char* probe_candidate_name(const probe_candidate* candidate);
+
+// log the capabilities and measurements of a probe
+void probe_log(const char* source, const probe_result* result, bool cached);
+
+// cache key of a compositor and driver, protocol versions are part of it so updates probe again
+void probe_key(char* key, size_t size, const probe_result* result, const char* driver);
+
+typedef enum {
+    PROBE_CLAIM_CACHED, // the result was filled in from memory or the on-disk cache
+    PROBE_CLAIM_OWNER, // the caller probes and releases the claim with its result
+    PROBE_CLAIM_BUSY // another source is probing the same display, capture with the defaults and try again later
+} probe_claim_result;
+
+// look up the probe of a display, or claim it if no source has probed it yet, shared by all sources
+probe_claim_result probe_claim(const char* key, probe_result* result);
+
+// release a claim with the result of the probe, stored on disk if a candidate works, NULL gives up the claim
+void probe_release(const char* key, const probe_result* result);
@@ -0,0 +1,218 @@
+#include "record.h"
+
+#include <obs/util/base.h>
+#include <obs/util/bmem.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define RECORD_ALIGN(x) (((x) + 7) & ~(uint64_t) 7)
+
+struct record_writer {
+    FILE* file;
+    record_header header;
+    uint64_t offset; // end of the written data
+    uint64_t first_time;
+
+    record_frame* frames;
+    uint64_t frame_capacity;
+};
+
+struct record_reader {
+    const uint8_t* data;
+    uint64_t size;
+    const record_header* header;
+    const record_frame* frames;
+};
+
+// recording
+
+static bool record_writer_write(record_writer* writer, const void* data, uint64_t size) {
+    static const uint8_t padding[8] = { 0 };
+    uint64_t aligned = RECORD_ALIGN(size);
+    if (fwrite(data, 1, size, writer->file) != size || fwrite(padding, 1, aligned - size, writer->file) != aligned - size)
+        return false;
+    writer->offset += aligned;
+    return true;
+}
+
+record_writer* record_writer_open(const char* path, uint32_t width, uint32_t height, uint32_t format, uint32_t bytes_per_pixel) {
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        blog(LOG_ERROR, "Failed to create recording %s", path);
+        return NULL;
+    }
+
+    record_writer* writer = bzalloc(sizeof(record_writer));
+    writer->file = file;
+    memcpy(writer->header.magic, RECORD_MAGIC, sizeof(writer->header.magic));
+    writer->header.width = width;
+    writer->header.height = height;
+    writer->header.format = format;
+    writer->header.bytes_per_pixel = bytes_per_pixel;
+
+    // the header is rewritten with the index on close
+    if (!record_writer_write(writer, &writer->header, sizeof(record_header))) {
+        blog(LOG_ERROR, "Failed to write recording %s", path);
+        fclose(file);
+        bfree(writer);
+        return NULL;
+    }
+
+    blog(LOG_INFO, "Recording %ux%u frames to %s", width, height, path);
+    return writer;
+}
+
+bool record_writer_add(record_writer* writer, uint64_t time, uint64_t presentation_time, uint32_t flags,
+    const damage_region* damage, const uint8_t* pixels, uint32_t stride) {
+    // the first frame is complete so a replay has something to start from
+    damage_region full;
+    if (writer->header.frame_count == 0) {
+        damage_region_full(&full, writer->header.width, writer->header.height);
+        damage = &full;
+        writer->first_time = time;
+    }
+
+    if (writer->header.frame_count == writer->frame_capacity) {
+        writer->frame_capacity = writer->frame_capacity ? writer->frame_capacity * 2 : 1024;
+        writer->frames = brealloc(writer->frames, sizeof(record_frame) * writer->frame_capacity);
+    }
+
+    record_frame* frame = &writer->frames[writer->header.frame_count];
+    frame->time = time - writer->first_time;
+    frame->presentation_age = presentation_time && presentation_time <= time ? time - presentation_time : 0;
+    frame->offset = writer->offset;
+    frame->damage_count = damage->count;
+    frame->flags = flags;
+
+    // damage rects followed by their rows
+    bool written = record_writer_write(writer, damage->rects, sizeof(damage_rect) * damage->count);
+    for (uint32_t i = 0; i < damage->count && written; i++) {
+        const damage_rect* rect = &damage->rects[i];
+        uint64_t row = (uint64_t) rect->width * writer->header.bytes_per_pixel;
+        for (uint32_t y = rect->y; y < rect->y + rect->height && written; y++)
+            written = fwrite(pixels + (uint64_t) y * stride + (uint64_t) rect->x * writer->header.bytes_per_pixel, 1, row, writer->file) == row;
+        writer->offset += row * rect->height;
+    }
+
+    // keep the next frame aligned
+    static const uint8_t padding[8] = { 0 };
+    uint64_t aligned = RECORD_ALIGN(writer->offset);
+    written = written && fwrite(padding, 1, aligned - writer->offset, writer->file) == aligned - writer->offset;
+    writer->offset = aligned;
+
+    if (!written) {
+        blog(LOG_ERROR, "Failed to write frame %lu of the recording", writer->header.frame_count);
+        return false;
+    }
+    writer->header.frame_count++;
+    return true;
+}
+
+bool record_writer_matches(const record_writer* writer, uint32_t width, uint32_t height, uint32_t format) {
+    return writer->header.width == width && writer->header.height == height && writer->header.format == format;
+}
+
+void record_writer_close(record_writer* writer) {
+    writer->header.index_offset = writer->offset;
+    bool written = writer->header.frame_count == 0 || fwrite(writer->frames, sizeof(record_frame), writer->header.frame_count, writer->file) == writer->header.frame_count;
+    written = written && fseek(writer->file, 0, SEEK_SET) == 0 && fwrite(&writer->header, sizeof(record_header), 1, writer->file) == 1;
+    written = fclose(writer->file) == 0 && written;
+    if (written)
+        blog(LOG_INFO, "Recorded %lu frames", writer->header.frame_count);
+    else
+        blog(LOG_ERROR, "Failed to finish the recording");
+
+    bfree(writer->frames);
+    bfree(writer);
+}
+
+// replay
+
+static bool record_reader_validate(const record_reader* reader) {
+    const record_header* header = reader->header;
+    if (header->bytes_per_pixel == 0 || header->bytes_per_pixel > 16 || header->index_offset > reader->size
+        || header->frame_count > (reader->size - header->index_offset) / sizeof(record_frame))
+        return false;
+
+    // every frame has to stay inside the file and its rects inside the image
+    for (uint64_t i = 0; i < header->frame_count; i++) {
+        const record_frame* frame = &reader->frames[i];
+        if (frame->damage_count > MAX_DAMAGE_RECTS || frame->offset % 8 || frame->offset + sizeof(damage_rect) * frame->damage_count > header->index_offset)
+            return false;
+
+        const damage_rect* rects = (const damage_rect*) (reader->data + frame->offset);
+        uint64_t size = sizeof(damage_rect) * frame->damage_count;
+        for (uint32_t j = 0; j < frame->damage_count; j++) {
+            if ((uint64_t) rects[j].x + rects[j].width > header->width || (uint64_t) rects[j].y + rects[j].height > header->height)
+                return false;
+            size += (uint64_t) rects[j].width * rects[j].height * header->bytes_per_pixel;
+        }
+        if (frame->offset + size > header->index_offset)
+            return false;
+    }
+    return true;
+}
+
+record_reader* record_reader_open(const char* path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        blog(LOG_ERROR, "Failed to open recording %s", path);
+        return NULL;
+    }
+
+    struct stat st;
+    void* data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (uint64_t) st.st_size >= sizeof(record_header))
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        blog(LOG_ERROR, "Failed to map recording %s", path);
+        return NULL;
+    }
+
+    record_reader* reader = bzalloc(sizeof(record_reader));
+    reader->data = data;
+    reader->size = st.st_size;
+    reader->header = data;
+    reader->frames = (const record_frame*) (reader->data + reader->header->index_offset);
+    if (memcmp(reader->header->magic, RECORD_MAGIC, sizeof(reader->header->magic)) != 0 || !record_reader_validate(reader)) {
+        blog(LOG_ERROR, "Recording %s is invalid or was not finished", path);
+        record_reader_close(reader);
+        return NULL;
+    }
+
+    blog(LOG_INFO, "Replaying %lu frames of %ux%u from %s", reader->header->frame_count, reader->header->width, reader->header->height, path);
+    return reader;
+}
+
+void record_reader_close(record_reader* reader) {
+    munmap((void*) reader->data, reader->size);
+    bfree(reader);
+}
+
+const record_header* record_reader_header(const record_reader* reader) {
+    return reader->header;
+}
+
+const record_frame* record_reader_frame(const record_reader* reader, uint64_t index) {
+    return index < reader->header->frame_count ? &reader->frames[index] : NULL;
+}
+
+void record_reader_apply(const record_reader* reader, const record_frame* frame, uint8_t* image, uint32_t stride, damage_region* damage) {
+    const uint32_t bpp = reader->header->bytes_per_pixel;
+    const damage_rect* rects = (const damage_rect*) (reader->data + frame->offset);
+    const uint8_t* pixels = (const uint8_t*) (rects + frame->damage_count);
+    for (uint32_t i = 0; i < frame->damage_count; i++) {
+        const damage_rect* rect = &rects[i];
+        uint64_t row = (uint64_t) rect->width * bpp;
+        for (uint32_t y = rect->y; y < rect->y + rect->height; y++) {
+            memcpy(image + (uint64_t) y * stride + (uint64_t) rect->x * bpp, pixels, row);
+            pixels += row;
+        }
+        damage_region_add(damage, rect->x, rect->y, rect->width, rect->height, reader->header->width, reader->header->height);
+    }
+}
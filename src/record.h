@@ -0,0 +1,56 @@
+#pragma once
+
+#include "damage.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// recordings hold the damaged pixels of every captured frame, the first frame is always complete:
+//   record_header, frame data..., record_frame index[frame_count]
+// frame data is the damage_rect array followed by the rows of every rect, all 8 byte aligned
+
+#define RECORD_MAGIC "SCRECv01"
+
+typedef struct {
+    char magic[8];
+    uint32_t width;
+    uint32_t height;
+    uint32_t format; // drm format of the captured buffers
+    uint32_t bytes_per_pixel;
+    uint64_t frame_count;
+    uint64_t index_offset;
+} record_header;
+
+typedef struct {
+    uint64_t time; // capture time in ns since the first frame
+    uint64_t presentation_age; // ns between compositor presentation and capture, 0 if unknown
+    uint64_t offset; // frame data in the file
+    uint32_t damage_count;
+    uint32_t flags; // screencopy frame flags
+} record_frame;
+
+typedef struct record_writer record_writer;
+typedef struct record_reader record_reader;
+
+// start a recording, frames have to match the given size and format
+record_writer* record_writer_open(const char* path, uint32_t width, uint32_t height, uint32_t format, uint32_t bytes_per_pixel);
+
+// append the damaged pixels of a frame, times are monotonic in ns
+bool record_writer_add(record_writer* writer, uint64_t time, uint64_t presentation_time, uint32_t flags,
+    const damage_region* damage, const uint8_t* pixels, uint32_t stride);
+
+// check whether frames of the given size and format can be added
+bool record_writer_matches(const record_writer* writer, uint32_t width, uint32_t height, uint32_t format);
+
+// write the index and close the file
+void record_writer_close(record_writer* writer);
+
+// map a recording, NULL if it is missing or invalid
+record_reader* record_reader_open(const char* path);
+void record_reader_close(record_reader* reader);
+
+const record_header* record_reader_header(const record_reader* reader);
+const record_frame* record_reader_frame(const record_reader* reader, uint64_t index);
+
+// copy the damaged pixels of a frame into an image and add its damage to a region
+void record_reader_apply(const record_reader* reader, const record_frame* frame, uint8_t* image, uint32_t stride, damage_region* damage);
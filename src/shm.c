@@ -0,0 +1,94 @@
+#define _GNU_SOURCE
+#include "shm.h"
+
+#include <fcntl.h>
+#include <gbm.h>
+#include <linux/udmabuf.h>
+#include <obs/util/base.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// shared memory pool
+
+bool shm_pool_create(shm_pool* pool, struct wl_shm* shm, size_t size) {
+    memset(pool, 0, sizeof(shm_pool));
+    pool->fd = memfd_create("obs-screencopy", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (pool->fd < 0 || ftruncate(pool->fd, size) < 0) {
+        blog(LOG_ERROR, "Failed to allocate %zu bytes of shared memory", size);
+        if (pool->fd >= 0)
+            close(pool->fd);
+        return false;
+    }
+
+    // the compositor must not shrink the memory while it is mapped
+    fcntl(pool->fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_SEAL);
+
+    pool->data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, pool->fd, 0);
+    if (pool->data == MAP_FAILED) {
+        blog(LOG_ERROR, "Failed to map shared memory");
+        close(pool->fd);
+        return false;
+    }
+
+    pool->size = size;
+    pool->pool = wl_shm_create_pool(shm, pool->fd, size);
+    return true;
+}
+
+void shm_pool_destroy(shm_pool* pool) {
+    if (!pool->pool)
+        return;
+
+    wl_shm_pool_destroy(pool->pool);
+    munmap(pool->data, pool->size);
+    close(pool->fd);
+    memset(pool, 0, sizeof(shm_pool));
+}
+
+// buffer layout
+
+uint32_t shm_stride_align(uint32_t width, uint32_t bytes_per_pixel) {
+    return (width * bytes_per_pixel + SHM_STRIDE_ALIGN - 1) & ~(uint32_t) (SHM_STRIDE_ALIGN - 1);
+}
+
+size_t shm_slot_size(uint32_t stride, uint32_t height) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    return ((size_t) stride * height + page - 1) / page * page;
+}
+
+int shm_pool_export_dmabuf(shm_pool* pool, size_t offset, size_t size) {
+    // the memfd is sealed against shrinking, which udmabuf requires
+    int device = open("/dev/udmabuf", O_RDWR | O_CLOEXEC);
+    if (device < 0)
+        return -1;
+
+    struct udmabuf_create create = {
+        .memfd = pool->fd,
+        .flags = UDMABUF_FLAGS_CLOEXEC,
+        .offset = offset,
+        .size = size
+    };
+    int fd = ioctl(device, UDMABUF_CREATE, &create);
+    close(device);
+    return fd < 0 ? -1 : fd;
+}
+
+// format codes
+
+uint32_t shm_format_to_drm(uint32_t shm_format) {
+    if (shm_format == WL_SHM_FORMAT_ARGB8888)
+        return GBM_FORMAT_ARGB8888;
+    if (shm_format == WL_SHM_FORMAT_XRGB8888)
+        return GBM_FORMAT_XRGB8888;
+    return shm_format;
+}
+
+uint32_t shm_format_from_drm(uint32_t drm_format) {
+    if (drm_format == GBM_FORMAT_ARGB8888)
+        return WL_SHM_FORMAT_ARGB8888;
+    if (drm_format == GBM_FORMAT_XRGB8888)
+        return WL_SHM_FORMAT_XRGB8888;
+    return drm_format;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <wayland-client.h>
+
+#define SHM_STRIDE_ALIGN 256 // pitch alignment linear dma-bufs are importable with on common gpus, for strides chosen by us
+#define SHM_DMABUF_MODIFIER 0 // DRM_FORMAT_MOD_LINEAR, exported slots are plain rows of pixels
+
+typedef struct {
+    int fd;
+    uint8_t* data; // mapped for the lifetime of the pool
+    size_t size;
+    struct wl_shm_pool* pool;
+} shm_pool;
+
+// create a pool of shared memory backed by a memfd
+bool shm_pool_create(shm_pool* pool, struct wl_shm* shm, size_t size);
+void shm_pool_destroy(shm_pool* pool);
+
+// row stride for frames whose layout is up to the client
+uint32_t shm_stride_align(uint32_t width, uint32_t bytes_per_pixel);
+
+// size of a buffer slot in a pool, rounded up to whole pages so every slot starts page aligned
+size_t shm_slot_size(uint32_t stride, uint32_t height);
+
+// export a page aligned range of the pool as a dma-buf through udmabuf, -1 if the kernel or permissions do not allow it
+int shm_pool_export_dmabuf(shm_pool* pool, size_t offset, size_t size);
+
+// convert between wl_shm and drm format codes, which only differ for argb8888 and xrgb8888
+uint32_t shm_format_to_drm(uint32_t shm_format);
+uint32_t shm_format_from_drm(uint32_t drm_format);
@@ -0,0 +1,170 @@
+#define _GNU_SOURCE
+#include "stats.h"
+
+#include <obs/util/base.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// latency histogram
+
+void latency_histogram_add(latency_histogram* histogram, uint64_t latency_ns) {
+    uint64_t bucket = latency_ns / LATENCY_BUCKET_NS;
+    histogram->buckets[bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1]++;
+    histogram->count++;
+}
+
+uint64_t latency_histogram_percentile(const latency_histogram* histogram, double percentile) {
+    uint64_t count = histogram->count;
+    if (count == 0)
+        return 0;
+
+    uint64_t rank = (uint64_t) (count * percentile / 100.0);
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += histogram->buckets[i];
+        if (seen > rank)
+            return (uint64_t) (i + 1) * LATENCY_BUCKET_NS;
+    }
+    return (uint64_t) LATENCY_BUCKETS * LATENCY_BUCKET_NS;
+}
+
+// stats server
+
+#define STATS_MAX_SOURCES 64
+
+typedef struct {
+    void* source;
+    stats_collect_t collect;
+} stats_entry;
+
+static stats_entry stats_sources[STATS_MAX_SOURCES];
+static uint32_t stats_source_count = 0;
+static pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_mutex_t stats_server_mutex = PTHREAD_MUTEX_INITIALIZER; // held around adding and removing sources with the start and stop they cause, never by the server thread
+static pthread_t stats_thread;
+static int stats_fd = -1;
+static volatile bool stats_stopsignal = false;
+static char stats_path[108];
+
+const char* stats_server_path() {
+    if (stats_path[0] == '\0') {
+        const char* runtime_dir = getenv("XDG_RUNTIME_DIR");
+        snprintf(stats_path, sizeof(stats_path), "%s/obs-screencopy-%d.sock", runtime_dir ? runtime_dir : "/tmp", getpid());
+    }
+    return stats_path;
+}
+
+static void stats_server_reply(int fd) {
+    // one json document with every served source per connection
+    obs_data_t* reply = obs_data_create();
+    obs_data_array_t* sources = obs_data_array_create();
+    pthread_mutex_lock(&stats_mutex);
+    for (uint32_t i = 0; i < stats_source_count; i++) {
+        obs_data_t* stats = obs_data_create();
+        stats_sources[i].collect(stats_sources[i].source, stats);
+        obs_data_array_push_back(sources, stats);
+        obs_data_release(stats);
+    }
+    pthread_mutex_unlock(&stats_mutex);
+    obs_data_set_array(reply, "sources", sources);
+    obs_data_array_release(sources);
+
+    const char* json = obs_data_get_json(reply);
+    size_t length = strlen(json), offset = 0;
+    while (offset < length) {
+        ssize_t n = write(fd, json + offset, length - offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        offset += n;
+    }
+    obs_data_release(reply);
+}
+
+static void* stats_server_thread(void* _) {
+    // poll with a timeout so the stop signal is noticed
+    struct pollfd pfd = { .fd = stats_fd, .events = POLLIN };
+    while (!stats_stopsignal) {
+        if (poll(&pfd, 1, 100) <= 0)
+            continue;
+
+        int fd = accept4(stats_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0)
+            continue;
+        stats_server_reply(fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+static bool stats_server_start() {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", stats_server_path());
+    unlink(addr.sun_path);
+
+    stats_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (stats_fd < 0 || bind(stats_fd, (struct sockaddr*) &addr, sizeof(addr)) < 0 || listen(stats_fd, 4) < 0) {
+        blog(LOG_ERROR, "Failed to serve stats on %s: %s", addr.sun_path, strerror(errno));
+        if (stats_fd >= 0)
+            close(stats_fd);
+        stats_fd = -1;
+        return false;
+    }
+
+    stats_stopsignal = false;
+    pthread_create(&stats_thread, NULL, stats_server_thread, NULL);
+    blog(LOG_INFO, "Serving capture stats on %s", addr.sun_path);
+    return true;
+}
+
+static void stats_server_stop() {
+    stats_stopsignal = true;
+    pthread_join(stats_thread, NULL);
+    close(stats_fd);
+    unlink(stats_server_path());
+    stats_fd = -1;
+}
+
+void stats_server_add(void* source, stats_collect_t collect) {
+    pthread_mutex_lock(&stats_server_mutex);
+    pthread_mutex_lock(&stats_mutex);
+    bool added = false;
+    for (uint32_t i = 0; i < stats_source_count; i++)
+        added |= stats_sources[i].source == source;
+    if (!added && stats_source_count == STATS_MAX_SOURCES)
+        blog(LOG_WARNING, "Too many sources serve stats, ignoring source");
+    else if (!added)
+        stats_sources[stats_source_count++] = (stats_entry) { source, collect };
+    pthread_mutex_unlock(&stats_mutex);
+
+    // the server thread takes stats_mutex for replies, it is not held while starting or joining it
+    if (stats_source_count > 0 && stats_fd < 0)
+        stats_server_start();
+    pthread_mutex_unlock(&stats_server_mutex);
+}
+
+void stats_server_remove(void* source) {
+    pthread_mutex_lock(&stats_server_mutex);
+    pthread_mutex_lock(&stats_mutex);
+    for (uint32_t i = 0; i < stats_source_count; i++) {
+        if (stats_sources[i].source == source) {
+            stats_sources[i] = stats_sources[--stats_source_count];
+            break;
+        }
+    }
+    bool empty = stats_source_count == 0;
+    pthread_mutex_unlock(&stats_mutex);
+
+    if (empty && stats_fd >= 0)
+        stats_server_stop();
+    pthread_mutex_unlock(&stats_server_mutex);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <obs/obs.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define LATENCY_BUCKETS 128
+#define LATENCY_BUCKET_NS 250000 // 0.25 ms per bucket, the last bucket collects everything above 32 ms
+
+typedef struct {
+    volatile uint64_t buckets[LATENCY_BUCKETS];
+    volatile uint64_t count;
+} latency_histogram;
+
+// add a sample, only one thread may add samples
+void latency_histogram_add(latency_histogram* histogram, uint64_t latency_ns);
+
+// upper bound of the bucket containing the given percentile (0-100) in ns, 0 without samples
+uint64_t latency_histogram_percentile(const latency_histogram* histogram, double percentile);
+
+// fill an object with the stats of a source, called on the stats server thread
+typedef void (*stats_collect_t)(void* source, obs_data_t* stats);
+
+// serve the stats of a source through the local socket, the server is started with the first source
+void stats_server_add(void* source, stats_collect_t collect);
+
+// stop serving a source, the server is stopped with the last source
+void stats_server_remove(void* source);
+
+// path of the local socket
+const char* stats_server_path();
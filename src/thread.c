@@ -0,0 +1,90 @@
+#define _GNU_SOURCE
+#include "thread.h"
+
+#include <obs/util/base.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+// cpu affinity
+
+static bool thread_parse_affinity(const char* list, cpu_set_t* set) {
+    CPU_ZERO(set);
+    const char* p = list;
+    while (*p) {
+        char* end;
+        long first = strtol(p, &end, 10);
+        if (end == p || first < 0 || first >= CPU_SETSIZE)
+            return false;
+
+        long last = first;
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p || last < first || last >= CPU_SETSIZE)
+                return false;
+        }
+
+        for (long cpu = first; cpu <= last; cpu++)
+            CPU_SET(cpu, set);
+
+        p = end;
+        while (*p == ',' || *p == ' ')
+            p++;
+    }
+    return CPU_COUNT(set) > 0;
+}
+
+// scheduling
+
+bool thread_apply_options(const thread_options* options) {
+    bool applied = true;
+
+    // realtime policy, usually requires CAP_SYS_NICE or an rtprio limit
+    bool realtime = false;
+    if (options->policy != THREAD_POLICY_NORMAL) {
+        int policy = options->policy == THREAD_POLICY_FIFO ? SCHED_FIFO : SCHED_RR;
+        int min = sched_get_priority_min(policy), max = sched_get_priority_max(policy);
+        struct sched_param param = {
+            .sched_priority = options->priority < min ? min : options->priority > max ? max : options->priority
+        };
+        int error = pthread_setschedparam(pthread_self(), policy, &param);
+        if (error == 0) {
+            realtime = true;
+            blog(LOG_INFO, "Capture thread uses %s with priority %d", policy == SCHED_FIFO ? "SCHED_FIFO" : "SCHED_RR", param.sched_priority);
+        } else {
+            blog(LOG_WARNING, "Failed to enable realtime scheduling for the capture thread (%s), using nice level instead", strerror(error));
+            applied = false;
+        }
+    }
+
+    // nice level, per thread on linux
+    if (!realtime && options->nice != 0) {
+        if (setpriority(PRIO_PROCESS, gettid(), options->nice) == 0) {
+            blog(LOG_INFO, "Capture thread uses nice level %d", options->nice);
+        } else {
+            blog(LOG_WARNING, "Failed to set nice level %d for the capture thread (%s)", options->nice, strerror(errno));
+            applied = false;
+        }
+    }
+
+    // cpu affinity
+    if (strlen(options->affinity) != 0) {
+        cpu_set_t set;
+        if (!thread_parse_affinity(options->affinity, &set)) {
+            blog(LOG_WARNING, "Invalid CPU affinity '%s', expected a list like 2,3 or 4-7", options->affinity);
+            applied = false;
+        } else if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+            blog(LOG_WARNING, "Failed to pin the capture thread to CPUs %s", options->affinity);
+            applied = false;
+        } else {
+            blog(LOG_INFO, "Capture thread pinned to CPUs %s", options->affinity);
+        }
+    }
+
+    return applied;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdbool.h>
+
+typedef enum {
+    THREAD_POLICY_NORMAL,
+    THREAD_POLICY_RR,
+    THREAD_POLICY_FIFO
+} thread_policy;
+
+typedef struct {
+    thread_policy policy;
+    int priority; // realtime priority, 1 (lowest) to 99
+    int nice; // applied for the normal policy and when realtime scheduling is not permitted
+    char affinity[64]; // cpu list like "2,3" or "4-7", empty for all cpus
+} thread_options;
+
+// apply scheduling options to the calling thread, false if anything had to fall back
+bool thread_apply_options(const thread_options* options);
@@ -0,0 +1,114 @@
+#include "tiles.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TILES_X86
+#endif
+
+typedef void (*tiles_row_fn)(const uint8_t* previous, const uint8_t* pixels, uint32_t row_bytes, uint32_t tile_bytes, uint8_t* dirty);
+
+// kernels
+
+static inline bool tiles_equal_scalar(const uint8_t* a, const uint8_t* b, size_t len) {
+    return memcmp(a, b, len) == 0;
+}
+
+// compare one row of every tile that is not known to be dirty yet, a partial last tile is left to memcmp
+static inline __attribute__((always_inline)) void tiles_row(const uint8_t* previous, const uint8_t* pixels, uint32_t row_bytes, uint32_t tile_bytes, uint8_t* dirty,
+    bool (*equal)(const uint8_t*, const uint8_t*, size_t)) {
+    uint32_t offset = 0, tile = 0;
+    for (; offset + tile_bytes <= row_bytes; offset += tile_bytes, tile++)
+        if (!dirty[tile])
+            dirty[tile] = !equal(previous + offset, pixels + offset, tile_bytes);
+    if (offset < row_bytes && !dirty[tile])
+        dirty[tile] = memcmp(previous + offset, pixels + offset, row_bytes - offset) != 0;
+}
+
+static void tiles_row_scalar(const uint8_t* previous, const uint8_t* pixels, uint32_t row_bytes, uint32_t tile_bytes, uint8_t* dirty) {
+    tiles_row(previous, pixels, row_bytes, tile_bytes, dirty, tiles_equal_scalar);
+}
+
+#ifdef TILES_X86
+// the differences of a whole tile row are accumulated without branching, a tile row is a multiple of 64 bytes
+__attribute__((target("avx2"), always_inline)) static inline bool tiles_equal_avx2(const uint8_t* a, const uint8_t* b, size_t len) {
+    __m256i diff = _mm256_setzero_si256();
+    for (size_t i = 0; i < len; i += 64) {
+        diff = _mm256_or_si256(diff, _mm256_xor_si256(_mm256_loadu_si256((const __m256i*) (a + i)), _mm256_loadu_si256((const __m256i*) (b + i))));
+        diff = _mm256_or_si256(diff, _mm256_xor_si256(_mm256_loadu_si256((const __m256i*) (a + i + 32)), _mm256_loadu_si256((const __m256i*) (b + i + 32))));
+    }
+    return _mm256_testz_si256(diff, diff);
+}
+
+__attribute__((target("avx2"))) static void tiles_row_avx2(const uint8_t* previous, const uint8_t* pixels, uint32_t row_bytes, uint32_t tile_bytes, uint8_t* dirty) {
+    tiles_row(previous, pixels, row_bytes, tile_bytes, dirty, tiles_equal_avx2);
+}
+#endif
+
+// kernel selection
+
+tiles_kernel tiles_kernel_best() {
+#ifdef TILES_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return TILES_AVX2;
+#endif
+    return TILES_SCALAR;
+}
+
+const char* tiles_kernel_name(tiles_kernel kernel) {
+    switch (kernel) {
+    case TILES_AVX2:
+        return "avx2";
+    default:
+        return "scalar";
+    }
+}
+
+static tiles_row_fn tiles_kernel_row(tiles_kernel kernel) {
+#ifdef TILES_X86
+    if (kernel == TILES_AVX2)
+        return tiles_row_avx2;
+#endif
+    return tiles_row_scalar;
+}
+
+// comparison
+
+uint32_t tiles_compare(tiles_kernel kernel, uint8_t* previous, uint32_t previous_stride, const uint8_t* pixels, uint32_t stride,
+    uint32_t width, uint32_t height, uint32_t bytes_per_pixel, uint8_t* dirty) {
+    const uint32_t tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE, tiles_y = (height + TILE_SIZE - 1) / TILE_SIZE;
+    const uint32_t row_bytes = width * bytes_per_pixel, tile_bytes = TILE_SIZE * bytes_per_pixel;
+    memset(dirty, 0, tiles_x * tiles_y);
+
+    // rows are walked in memory order, tiles stop being compared once they differ
+    tiles_row_fn row = tiles_kernel_row(kernel);
+    for (uint32_t y = 0; y < height; y++)
+        row(previous + (size_t) y * previous_stride, pixels + (size_t) y * stride, row_bytes, tile_bytes, dirty + (y / TILE_SIZE) * tiles_x);
+
+    // bring the previous frame up to date, adjacent dirty tiles are copied together
+    uint32_t count = 0;
+    for (uint32_t ty = 0; ty < tiles_y; ty++) {
+        const uint8_t* band = dirty + ty * tiles_x;
+        for (uint32_t tx = 0; tx < tiles_x; tx++) {
+            if (!band[tx])
+                continue;
+
+            uint32_t run = 1;
+            while (tx + run < tiles_x && band[tx + run])
+                run++;
+
+            size_t offset = (size_t) tx * tile_bytes;
+            size_t len = (tx + run) * tile_bytes > row_bytes ? row_bytes - offset : (size_t) run * tile_bytes;
+            for (uint32_t y = ty * TILE_SIZE; y < (ty + 1) * TILE_SIZE && y < height; y++)
+                memcpy(previous + (size_t) y * previous_stride + offset, pixels + (size_t) y * stride + offset, len);
+
+            count += run;
+            tx += run - 1;
+        }
+    }
+    return count;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+
+#define TILE_SIZE 64 // frames are compared and uploaded in square tiles of this size
+
+typedef enum {
+    TILES_SCALAR, // memcmp, vectorized by the c library
+    TILES_AVX2
+} tiles_kernel;
+
+// fastest comparison kernel supported by the cpu
+tiles_kernel tiles_kernel_best();
+const char* tiles_kernel_name(tiles_kernel kernel);
+
+// compare a frame against the previous one and mark the changed tiles in dirty (tiles_x * tiles_y),
+// changed tiles are copied into previous so it follows the frame, returns the number of changed tiles
+uint32_t tiles_compare(tiles_kernel kernel, uint8_t* previous, uint32_t previous_stride, const uint8_t* pixels, uint32_t stride,
+    uint32_t width, uint32_t height, uint32_t bytes_per_pixel, uint8_t* dirty);
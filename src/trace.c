@@ -0,0 +1,117 @@
+#include "trace.h"
+
+#include <obs/util/base.h>
+#include <obs/util/bmem.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char* trace_event_names[] = {
+    [TRACE_REQUEST] = "request",
+    [TRACE_BUFFER_DONE] = "buffer_done",
+    [TRACE_COPY] = "copy",
+    [TRACE_READY] = "ready",
+    [TRACE_FAILED] = "failed",
+    [TRACE_PUBLISH] = "publish",
+    [TRACE_RENDER] = "render"
+};
+
+// ring buffer
+
+trace_ring* trace_ring_create(uint32_t capacity) {
+    uint32_t size = 1;
+    while (size < capacity && size < (1u << 24))
+        size <<= 1;
+
+    trace_ring* ring = bzalloc(sizeof(trace_ring));
+    ring->events = bzalloc(sizeof(trace_event) * size);
+    ring->capacity = size;
+    return ring;
+}
+
+void trace_ring_destroy(trace_ring* ring) {
+    bfree(ring->events);
+    bfree(ring);
+}
+
+void trace_ring_record(trace_ring* ring, uint32_t track, trace_event_type type, uint64_t compositor_time) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    // claim a slot, writers never wait for each other or for the reader
+    uint64_t index = __atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED);
+    trace_event* event = &ring->events[index & (ring->capacity - 1)];
+    __atomic_store_n(&event->sequence, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    event->time = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    event->compositor_time = compositor_time;
+    event->type = type;
+    event->track = track;
+    __atomic_store_n(&event->sequence, index + 1, __ATOMIC_RELEASE);
+}
+
+// chrome trace export
+
+static void trace_track_name(uint32_t track, char* name, size_t size) {
+    if (track == TRACE_TRACK_RENDER)
+        snprintf(name, size, "render");
+    else if (track == TRACE_TRACK_CURSOR)
+        snprintf(name, size, "cursor");
+    else
+        snprintf(name, size, "target %u", track - TRACE_TRACK_TARGET);
+}
+
+bool trace_ring_dump(trace_ring* ring, const char* path) {
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        blog(LOG_ERROR, "Failed to open trace file %s", path);
+        return false;
+    }
+
+    // only events that are still completely in the ring are exported
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint64_t first = head > ring->capacity ? head - ring->capacity : 0;
+    int pid = getpid();
+    uint32_t tracks = 0, count = 0, written_events = 0;
+    char name[32];
+
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    for (uint64_t index = first; index < head; index++) {
+        trace_event* slot = &ring->events[index & (ring->capacity - 1)];
+        uint64_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        trace_event event = *slot;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (sequence != index + 1 || __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) != sequence || event.type > TRACE_RENDER)
+            continue; // overwritten or still being written
+
+        fprintf(file, "%s\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":%d,\"tid\":%u,\"ts\":%.3f",
+            count++ ? "," : "", trace_event_names[event.type], pid, event.track, event.time / 1000.0);
+        if (event.compositor_time)
+            fprintf(file, ",\"args\":{\"compositor_ts\":%.3f,\"latency_us\":%.3f}",
+                event.compositor_time / 1000.0, ((int64_t) event.time - (int64_t) event.compositor_time) / 1000.0);
+        fprintf(file, "}");
+        written_events++;
+        if (event.track < 32)
+            tracks |= 1u << event.track;
+    }
+
+    // name the tracks so timelines of the targets line up below the render ticks
+    for (uint32_t track = 0; track < 32; track++) {
+        if (!(tracks & (1u << track)))
+            continue;
+        trace_track_name(track, name, sizeof(name));
+        fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+            count++ ? "," : "", pid, track, name);
+        fprintf(file, ",\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"sort_index\":%u}}",
+            pid, track, track);
+    }
+    fprintf(file, "\n]}\n");
+
+    bool written = !ferror(file);
+    written &= fclose(file) == 0;
+    if (written)
+        blog(LOG_INFO, "Wrote %u trace events to %s", written_events, path);
+    else
+        blog(LOG_ERROR, "Failed to write trace file %s", path);
+    return written;
+}
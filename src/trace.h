@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+    TRACE_REQUEST, // frame requested from the compositor
+    TRACE_BUFFER_DONE, // buffer parameters received
+    TRACE_COPY, // buffer attached and copy requested
+    TRACE_READY, // frame copied, carries the compositor timestamp
+    TRACE_FAILED,
+    TRACE_PUBLISH, // texture handed to the render thread
+    TRACE_RENDER // source drawn by obs
+} trace_event_type;
+
+typedef struct {
+    volatile uint64_t sequence; // index + 1 once written, 0 while being written
+    uint64_t time; // monotonic time in ns
+    uint64_t compositor_time; // presentation time reported with the frame, 0 if unknown
+    uint32_t type;
+    uint32_t track; // capture target, see trace_track_name
+} trace_event;
+
+typedef struct {
+    trace_event* events;
+    uint32_t capacity; // power of two, oldest events are overwritten
+    volatile uint64_t head;
+} trace_ring;
+
+#define TRACE_TRACK_RENDER 0
+#define TRACE_TRACK_CURSOR 1
+#define TRACE_TRACK_TARGET 2 // first capture target, followed by the others
+
+// create a ring for the given number of events, rounded up to a power of two
+trace_ring* trace_ring_create(uint32_t capacity);
+
+// destroy a ring, no thread may record into it anymore
+void trace_ring_destroy(trace_ring* ring);
+
+// record an event, safe to call from any thread without locking
+void trace_ring_record(trace_ring* ring, uint32_t track, trace_event_type type, uint64_t compositor_time);
+
+// write all events still in the ring to a chrome trace json file
+bool trace_ring_dump(trace_ring* ring, const char* path);
+
+// record an event if tracing is enabled, a single branch otherwise
+static inline void trace_record(trace_ring* ring, uint32_t track, trace_event_type type, uint64_t compositor_time) {
+    if (__builtin_expect(ring != NULL, 0))
+        trace_ring_record(ring, track, type, compositor_time);
+}
@@ -0,0 +1,163 @@
+#include "upload.h"
+
+#include <obs/util/bmem.h>
+#include <string.h>
+
+typedef struct {
+    uint32_t x, y; // destination in the texture
+    uint32_t slot_x; // source in the staging strip
+    uint32_t width, height;
+} upload_copy;
+
+// persistent texture
+
+bool upload_texture_create(upload_texture* upload, uint32_t width, uint32_t height, enum gs_color_format format, uint32_t bytes_per_pixel) {
+    memset(upload, 0, sizeof(upload_texture));
+    upload->texture = gs_texture_create(width, height, format, 1, NULL, GS_DYNAMIC);
+    upload->staging = gs_texture_create(UPLOAD_TILE_SIZE * UPLOAD_STRIP_TILES, UPLOAD_TILE_SIZE, format, 1, NULL, GS_DYNAMIC);
+    if (!upload->texture || !upload->staging) {
+        upload_texture_destroy(upload);
+        return false;
+    }
+
+    upload->width = width;
+    upload->height = height;
+    upload->bytes_per_pixel = bytes_per_pixel;
+    upload->tiles_x = (width + UPLOAD_TILE_SIZE - 1) / UPLOAD_TILE_SIZE;
+    upload->tiles_y = (height + UPLOAD_TILE_SIZE - 1) / UPLOAD_TILE_SIZE;
+    upload->dirty = bzalloc(upload->tiles_x * upload->tiles_y);
+    upload->kernel = tiles_kernel_best();
+    return true;
+}
+
+void upload_texture_destroy(upload_texture* upload) {
+    gs_texture_destroy(upload->texture);
+    gs_texture_destroy(upload->staging);
+    bfree(upload->dirty);
+    bfree(upload->previous);
+    memset(upload, 0, sizeof(upload_texture));
+}
+
+// partial updates
+
+static uint64_t upload_strip_flush(upload_texture* upload, const upload_copy* copies, uint32_t count) {
+    gs_texture_unmap(upload->staging);
+    for (uint32_t i = 0; i < count; i++)
+        gs_copy_texture_region(upload->texture, copies[i].x, copies[i].y, upload->staging, copies[i].slot_x, 0, copies[i].width, copies[i].height);
+
+    // the whole strip is transferred, no matter how much of it is used
+    return (uint64_t) UPLOAD_TILE_SIZE * UPLOAD_STRIP_TILES * UPLOAD_TILE_SIZE * upload->bytes_per_pixel;
+}
+
+static uint64_t upload_texture_full(upload_texture* upload, const uint8_t* pixels, uint32_t stride) {
+    gs_texture_set_image(upload->texture, pixels, stride, false);
+    upload->complete = true;
+    return (uint64_t) upload->width * upload->height * upload->bytes_per_pixel;
+}
+
+// upload the tiles marked in the dirty mask
+static uint64_t upload_texture_tiles(upload_texture* upload, const uint8_t* pixels, uint32_t stride) {
+    if (upload->dirty_count == 0)
+        return 0;
+
+    // large updates are cheaper in one transfer
+    if (upload->dirty_count > upload->tiles_x * upload->tiles_y * UPLOAD_FULL_THRESHOLD)
+        return upload_texture_full(upload, pixels, stride);
+
+    // pack runs of dirty tiles into the staging strip and copy them into place on the gpu
+    const uint32_t bpp = upload->bytes_per_pixel;
+    upload_copy copies[UPLOAD_STRIP_TILES];
+    uint32_t copy_count = 0, slot = 0, linesize = 0;
+    uint8_t* strip = NULL;
+    uint64_t uploaded = 0;
+    for (uint32_t ty = 0; ty < upload->tiles_y; ty++) {
+        for (uint32_t tx = 0; tx < upload->tiles_x; tx++) {
+            if (!upload->dirty[ty * upload->tiles_x + tx])
+                continue;
+
+            uint32_t run = 1;
+            while (tx + run < upload->tiles_x && run < UPLOAD_STRIP_TILES && upload->dirty[ty * upload->tiles_x + tx + run])
+                run++;
+
+            if (strip && slot + run > UPLOAD_STRIP_TILES) {
+                uploaded += upload_strip_flush(upload, copies, copy_count);
+                strip = NULL;
+            }
+            if (!strip) {
+                if (!gs_texture_map(upload->staging, &strip, &linesize))
+                    return uploaded + upload_texture_full(upload, pixels, stride);
+                copy_count = 0;
+                slot = 0;
+            }
+
+            upload_copy* copy = &copies[copy_count++];
+            copy->x = tx * UPLOAD_TILE_SIZE;
+            copy->y = ty * UPLOAD_TILE_SIZE;
+            copy->slot_x = slot * UPLOAD_TILE_SIZE;
+            copy->width = copy->x + run * UPLOAD_TILE_SIZE > upload->width ? upload->width - copy->x : run * UPLOAD_TILE_SIZE;
+            copy->height = copy->y + UPLOAD_TILE_SIZE > upload->height ? upload->height - copy->y : UPLOAD_TILE_SIZE;
+            for (uint32_t row = 0; row < copy->height; row++)
+                memcpy(strip + (size_t) row * linesize + (size_t) copy->slot_x * bpp,
+                    pixels + (size_t) (copy->y + row) * stride + (size_t) copy->x * bpp, (size_t) copy->width * bpp);
+
+            slot += run;
+            tx += run - 1;
+        }
+    }
+    if (strip)
+        uploaded += upload_strip_flush(upload, copies, copy_count);
+    return uploaded;
+}
+
+// marking, done before entering the graphics context so comparisons do not hold it
+
+void upload_texture_mark_damage(upload_texture* upload, const damage_region* damage) {
+    // the previous frame is only maintained while changes are detected
+    upload->previous_valid = false;
+    upload->full = !upload->complete;
+    upload->dirty_count = 0;
+    if (upload->full)
+        return;
+
+    // coalesce damage into tiles
+    memset(upload->dirty, 0, upload->tiles_x * upload->tiles_y);
+    for (uint32_t i = 0; i < damage->count; i++) {
+        const damage_rect* rect = &damage->rects[i];
+        if (rect->width == 0 || rect->height == 0)
+            continue;
+
+        uint32_t x2 = (rect->x + rect->width - 1) / UPLOAD_TILE_SIZE, y2 = (rect->y + rect->height - 1) / UPLOAD_TILE_SIZE;
+        for (uint32_t ty = rect->y / UPLOAD_TILE_SIZE; ty <= y2 && ty < upload->tiles_y; ty++) {
+            for (uint32_t tx = rect->x / UPLOAD_TILE_SIZE; tx <= x2 && tx < upload->tiles_x; tx++) {
+                upload->dirty_count += !upload->dirty[ty * upload->tiles_x + tx];
+                upload->dirty[ty * upload->tiles_x + tx] = 1;
+            }
+        }
+    }
+}
+
+void upload_texture_mark_changed(upload_texture* upload, const uint8_t* pixels, uint32_t stride, bool* unchanged) {
+    const uint32_t bpp = upload->bytes_per_pixel;
+    if (!upload->previous)
+        upload->previous = bmalloc((size_t) upload->width * upload->height * bpp);
+
+    // without a previous frame everything changed
+    if (!upload->previous_valid) {
+        for (uint32_t y = 0; y < upload->height; y++)
+            memcpy(upload->previous + (size_t) y * upload->width * bpp, pixels + (size_t) y * stride, (size_t) upload->width * bpp);
+        upload->previous_valid = true;
+        upload->full = true;
+        *unchanged = false;
+        return;
+    }
+
+    upload->dirty_count = tiles_compare(upload->kernel, upload->previous, upload->width * bpp, pixels, stride, upload->width, upload->height, bpp, upload->dirty);
+    upload->full = !upload->complete;
+    *unchanged = upload->dirty_count == 0;
+}
+
+uint64_t upload_texture_flush(upload_texture* upload, const uint8_t* pixels, uint32_t stride) {
+    if (upload->full)
+        return upload_texture_full(upload, pixels, stride);
+    return upload_texture_tiles(upload, pixels, stride);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "damage.h"
+#include "tiles.h"
+
+#include <obs/graphics/graphics.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define UPLOAD_TILE_SIZE TILE_SIZE // damage is coalesced into tiles of this size
+#define UPLOAD_STRIP_TILES 16 // tiles uploaded per staging transfer
+#define UPLOAD_FULL_THRESHOLD 0.5 // fraction of dirty tiles above which the whole frame is uploaded
+
+typedef struct {
+    gs_texture_t* texture; // persistent copy of the frame, sampled by obs
+    gs_texture_t* staging; // strip of tiles that is transferred at once
+    uint32_t width;
+    uint32_t height;
+    uint32_t bytes_per_pixel;
+    bool complete; // the texture holds a whole frame, partial updates are possible
+
+    uint32_t tiles_x;
+    uint32_t tiles_y;
+    uint8_t* dirty; // tiles to upload this frame
+    uint32_t dirty_count;
+    bool full; // the whole frame is uploaded by the next flush
+
+    tiles_kernel kernel;
+    uint8_t* previous; // last frame, compared against when the compositor reports no damage
+    bool previous_valid;
+} upload_texture;
+
+// create the persistent texture and its staging strip (requires graphics context)
+bool upload_texture_create(upload_texture* upload, uint32_t width, uint32_t height, enum gs_color_format format, uint32_t bytes_per_pixel);
+void upload_texture_destroy(upload_texture* upload);
+
+// mark the damaged tiles of a frame, or all of it if the texture is not complete yet
+void upload_texture_mark_damage(upload_texture* upload, const damage_region* damage);
+
+// compare a frame against the previous one and mark the changed tiles, unchanged is set if no tile differs
+void upload_texture_mark_changed(upload_texture* upload, const uint8_t* pixels, uint32_t stride, bool* unchanged);
+
+// upload the marked tiles of a frame, returns the uploaded bytes (requires graphics context)
+uint64_t upload_texture_flush(upload_texture* upload, const uint8_t* pixels, uint32_t stride);